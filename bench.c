@@ -0,0 +1,197 @@
+/*
+    headless benchmark. texter.c is built without its main and driven with
+    scripted keys on generated files, on a virtual screen whose frames go
+    to /dev/null instead of a terminal. every file runs in a child process
+    of its own, so each case starts from a fresh editor.
+
+    usage: texter_bench [largest file in MB, default 64, up to 4096]
+*/
+#define TEXTER_NO_MAIN
+#include "texter.c"
+
+#include <sys/wait.h>
+
+#define BENCH_ROWS 40
+#define BENCH_COLS 120
+#define BENCH_LONG_LINE (256 << 10) // line length of the "long" files
+#define BENCH_NEEDLE "needle"       // searched for, about one line in 64 has it
+
+struct benchKeys {
+    const char *name;
+    const char *seq;
+    int count;
+};
+
+// the key script replayed on every file, timed key by key
+struct benchKeys benchScript[] = {
+    {"type", "x", 200},
+    {"down", "\x1b[B", 100},
+    {"right", "\x1b[C", 50},
+    {"end", "\x1b[F", 10},
+    {"home", "\x1b[H", 10},
+    {"pgdown", "\x1b[6~", 20},
+    {"enter", "\r", 20},
+    {"backspace", "\x7f", 50},
+    {"pgup", "\x1b[5~", 20},
+};
+
+const char *benchWords[] = {
+    "the", "editor", "row", "buffer", "render", "frame", "search", "index",
+    "cursor", "screen", "terminal", "escape", "save", "swap", "undo", "key",
+};
+
+unsigned long long benchRand = 88172645463325252ULL;
+
+unsigned long long benchNext(){
+    benchRand ^= benchRand << 13;
+    benchRand ^= benchRand >> 7;
+    benchRand ^= benchRand << 17;
+    return benchRand;
+}
+
+// writes size bytes of text of the given kind: "text", "long" or "tabs"
+void benchGenerate(const char *path, const char *kind, long long size){
+    FILE *f = fopen(path, "w");
+    if(f == NULL) die("fopen");
+
+    long long written = 0;
+    int lineLen = 0, want = 0;
+    while(written < size){
+        if(lineLen == 0){
+            if(strcmp(kind, "long") == 0) want = BENCH_LONG_LINE;
+            else want = 20 + benchNext() % 80;
+            if(benchNext() % 64 == 0){
+                fputs(BENCH_NEEDLE " ", f);
+                lineLen += sizeof(BENCH_NEEDLE);
+            }
+        }
+
+        const char *w = benchWords[benchNext() % (sizeof(benchWords) / sizeof(benchWords[0]))];
+        int n = strlen(w);
+        fputs(w, f);
+        fputc(strcmp(kind, "tabs") == 0 && benchNext() % 2 ? '\t' : ' ', f);
+        lineLen += n + 1;
+
+        if(lineLen >= want || written + lineLen >= size){
+            fputc('\n', f);
+            written += lineLen + 1;
+            lineLen = 0;
+        }
+    }
+    fclose(f);
+}
+
+long long benchNowUs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+int benchCompare(const void *a, const void *b){
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// queues keys and runs them through the editor
+void benchKey(const char *seq){
+    editorFeedInput(seq, strlen(seq));
+    while(Ed.in.len) editorProcessKey();
+}
+
+void benchSize(char *buf, int len, long long size){
+    if(size >= 1LL << 30) snprintf(buf, len, "%lldG", size >> 30);
+    else if(size >= 1 << 20) snprintf(buf, len, "%lldM", size >> 20);
+    else snprintf(buf, len, "%lldK", size >> 10);
+}
+
+// opens the file, replays the script, searches and saves, prints one line
+void benchRun(char *path, const char *kind, long long size){
+    editorInit(BENCH_ROWS + 2, BENCH_COLS + 4);
+    Ed.outFd = open("/dev/null", O_WRONLY);
+    if(Ed.outFd == -1) die("open");
+
+    long long t = benchNowUs();
+    editorOpenFile(path);
+    editorRefreshScreen();
+    long long openUs = benchNowUs() - t;
+    editorIndexFinish();
+    long long indexUs = benchNowUs() - t;
+
+    int numKeys = 0;
+    for(size_t i = 0; i < sizeof(benchScript) / sizeof(benchScript[0]); i++) numKeys += benchScript[i].count;
+    long long *lat = malloc(sizeof(long long) * numKeys);
+    long long frameBytes = 0;
+    int k = 0;
+    for(size_t i = 0; i < sizeof(benchScript) / sizeof(benchScript[0]); i++){
+        for(int j = 0; j < benchScript[i].count; j++){
+            t = benchNowUs();
+            benchKey(benchScript[i].seq);
+            editorRefreshScreen();
+            lat[k++] = benchNowUs() - t;
+            frameBytes += Ed.out.len;
+        }
+    }
+    qsort(lat, numKeys, sizeof(long long), benchCompare);
+
+    t = benchNowUs();
+    benchKey("\x06" BENCH_NEEDLE "\r");
+    editorSearchFinish();
+    long long searchUs = benchNowUs() - t;
+    int matches = Ed.search.numMatches;
+    editorSearchStop();
+
+    t = benchNowUs();
+    benchKey("\x13");
+    editorSaveWait();
+    long long saveUs = benchNowUs() - t;
+    editorSwapClose(1);
+
+    char sz[16];
+    benchSize(sz, sizeof(sz), size);
+    printf("%-5s %5s %9.2f %9.2f %8lld %8lld %8lld %9.2f %8d %9.2f %10lld\n", kind, sz,
+        openUs / 1000.0, indexUs / 1000.0,
+        lat[numKeys / 2], lat[(numKeys - 1) * 99 / 100], lat[numKeys - 1],
+        searchUs / 1000.0, matches, saveUs / 1000.0, frameBytes / numKeys);
+    fflush(stdout);
+    free(lat);
+}
+
+int main(int argc, char *argv[]){
+    long long maxSize = (argc >= 2 ? atoll(argv[1]) : 64) << 20;
+    long long sizes[] = {1LL << 10, 1LL << 20, 64LL << 20, 1LL << 30, 4LL << 30};
+    const char *kinds[] = {"text", "long", "tabs"};
+
+    char dir[] = "/tmp/texter_bench.XXXXXX";
+    if(mkdtemp(dir) == NULL) die("mkdtemp");
+    char path[64];
+    snprintf(path, sizeof(path), "%s/file.txt", dir);
+
+    printf("%-5s %5s %9s %9s %8s %8s %8s %9s %8s %9s %10s\n", "kind", "size",
+        "open ms", "index ms", "key p50", "key p99", "key max", "search ms", "matches", "save ms", "bytes/frm");
+    int numKeys = 0;
+    for(size_t i = 0; i < sizeof(benchScript) / sizeof(benchScript[0]); i++) numKeys += benchScript[i].count;
+    printf("# %d keys per file on a %dx%d screen, key times in us include the frame\n",
+        numKeys, BENCH_ROWS, BENCH_COLS);
+
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= maxSize; s++){
+        for(size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++){
+            benchGenerate(path, kinds[i], sizes[s]);
+
+            // a fresh process per case, the editor keeps its state in globals
+            fflush(stdout);
+            pid_t pid = fork();
+            if(pid == -1) die("fork");
+            if(pid == 0){
+                benchRun(path, kinds[i], sizes[s]);
+                exit(0);
+            }
+            int status;
+            waitpid(pid, &status, 0);
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) printf("%s: run failed\n", kinds[i]);
+            unlink(path);
+        }
+    }
+
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,277 @@
+/*
+    headless tests. like bench.c, texter.c is built without its main and
+    driven with keys on a virtual screen whose frames go to /dev/null.
+    every test runs in a child process of its own, so each starts from a
+    fresh editor, and a crash fails only that test.
+
+    usage: texter_test
+*/
+#define TEXTER_NO_MAIN
+#include "texter.c"
+
+#include <sys/wait.h>
+
+#define TEST_ROWS 40
+#define TEST_COLS 120
+
+// fails the running test with the line of the check
+#define CHECK(cond) do{ \
+    if(!(cond)){ \
+        printf("    %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+}while(0)
+
+char testDir[] = "/tmp/texter_test.XXXXXX";
+
+// queues keys and runs them through the editor
+void testKey(const char *seq){
+    editorFeedInput(seq, strlen(seq));
+    while(Ed.in.len) editorProcessKey();
+    editorRefreshScreen();
+}
+
+// writes len bytes of text to name in the test dir, path gets its full name
+void testWrite(char *path, const char *name, const void *text, size_t len){
+    snprintf(path, PATH_MAX, "%s/%s", testDir, name);
+    FILE *f = fopen(path, "w");
+    if(f == NULL) die("fopen");
+    fwrite(text, 1, len, f);
+    fclose(f);
+}
+
+// a fresh editor with keys queued for it to read while opening path
+void testOpenPath(char *path, const char *keys){
+    editorInit(TEST_ROWS + 2, TEST_COLS + 4);
+    Ed.outFd = open("/dev/null", O_WRONLY);
+    if(Ed.outFd == -1) die("open");
+    editorFeedInput(keys, strlen(keys));
+    editorOpenFile(path);
+    editorIndexFinish();
+}
+
+// writes text to name in the test dir and opens it in a fresh editor
+void testOpen(const char *name, const char *text, size_t len){
+    char path[PATH_MAX];
+    testWrite(path, name, text, len);
+    testOpenPath(path, "");
+}
+
+// whether row y holds exactly s
+int testRowIs(int y, const char *s){
+    erow *row = editorRowAt(y);
+    return row->size == (int)strlen(s) && memcmp(row->data, s, row->size) == 0;
+}
+
+/* ----- tests ----- */
+
+// undoing a paste puts the cursor back where the paste started
+void testPasteUndo(){
+    testOpen("paste.txt", "", 0);
+    testKey("abc");
+    testKey("\x1b[200~one\rtwo\rthree\x1b[201~");
+    CHECK(Ed.numRows == 3);
+    CHECK(Ed.cy == 2 && Ed.cx == 5);
+
+    testKey("\x1a");
+    CHECK(Ed.numRows == 1);
+    CHECK(testRowIs(0, "abc"));
+    CHECK(Ed.cy == 0 && Ed.cx == 3);
+
+    testKey("d"); // used to run past the end of the file
+    CHECK(testRowIs(0, "abcd"));
+}
+
+// a file of n rows of mixed text, "aba" shows up on about one row in five
+void testOpenSearchFile(const char *name, int n){
+    struct ab_buf b = ab_BUF_INIT;
+    char line[64];
+    for(int i = 0; i < n; i++){
+        int len = snprintf(line, sizeof(line), i % 5 ? "row %d xyz ab\n" : "row %d ababa aba\n", i);
+        ab_append(&b, line, len);
+    }
+    testOpen(name, b.buf, b.len);
+    ab_free(&b);
+}
+
+// the match index holds every occurrence of the query, in order
+void testCheckMatches(){
+    struct searchState *st = &Ed.search;
+    int k = 0;
+    for(int y = 0; y < Ed.numRows; y++){
+        erow *row = editorRowAt(y);
+        for(int x = 0; x + st->qlen <= row->size; x++){
+            if(memcmp(&row->data[x], st->query, st->qlen) != 0) continue;
+            CHECK(k < st->numMatches);
+            CHECK(st->matches[k].y == y && st->matches[k].x == x);
+            k++;
+        }
+    }
+    CHECK(k == st->numMatches);
+}
+
+// edits while the search threads scan keep the index whole
+void testSearchEditDuring(){
+    struct searchState *st = &Ed.search;
+    testOpenSearchFile("during.txt", 300000);
+    editorSearchStart("aba");
+    CHECK(st->active);
+
+    Ed.cy = 5000; Ed.cx = 0;
+    testKey("x");
+
+    // scanning again from the paused row on, edit a row it already did.
+    // if the first key came too late to pause anything, nothing resumes
+    editorSearchResume();
+    while(st->active && !atomic_load(&st->chunks[0].done)){
+        struct timespec ts = {0, 1000000}; // 1ms
+        nanosleep(&ts, NULL);
+    }
+    Ed.cy = 5000; Ed.cx = 0;
+    testKey("aba");
+    editorSearchFinish();
+    testCheckMatches();
+}
+
+// edits after the threads finished, before their chunks were merged
+void testSearchEditAfter(){
+    struct searchState *st = &Ed.search;
+    testOpenSearchFile("after.txt", 300000);
+    editorSearchStart("aba");
+    CHECK(st->active);
+    for(int k = 0; k < st->numChunks; k++){
+        while(!atomic_load(&st->chunks[k].done)){
+            struct timespec ts = {0, 1000000}; // 1ms
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    Ed.cy = 0; Ed.cx = 0;
+    testKey("x");
+    Ed.cy = 5000; Ed.cx = 0;
+    testKey("aba");
+    editorSearchFinish();
+    testCheckMatches();
+}
+
+// appends a swap record: its type, then n int32 fields, then text
+void testSwapRecord(struct ab_buf *b, char type, const int32_t *f, int n, const char *text){
+    ab_appendc(b, type);
+    ab_append(b, (const char *)f, n * sizeof(int32_t));
+    ab_append(b, text, strlen(text));
+}
+
+// a damaged swap file is replayed up to its first bad record
+void testSwapReplayDamaged(){
+    char path[PATH_MAX], swap[PATH_MAX];
+    testWrite(path, "swap.txt", "hello\nworld\n", 12);
+
+    struct ab_buf b = ab_BUF_INIT;
+    struct swapHeader h;
+    editorSwapHeaderFor(&h, path);
+    ab_append(&b, (const char *)&h, sizeof(h));
+    testSwapRecord(&b, 'I', (int32_t[]){0, 1, 1}, 3, "X");
+    testSwapRecord(&b, 'I', (int32_t[]){0, 99, 1}, 3, "Y");      // x past the row
+    testSwapRecord(&b, 'D', (int32_t[]){1, 0, 0, 2}, 4, "");     // ends before it starts
+    testSwapRecord(&b, 'I', (int32_t[]){1, 0, -5}, 3, "");       // negative length
+    editorSwapPath(path, swap, sizeof(swap));
+    FILE *f = fopen(swap, "w");
+    if(f == NULL) die("fopen");
+    fwrite(b.buf, 1, b.len, f);
+    fclose(f);
+    ab_free(&b);
+
+    testOpenPath(path, "y\r");
+    CHECK(Ed.numRows == 2);
+    CHECK(testRowIs(0, "hXello"));
+    CHECK(testRowIs(1, "world"));
+    CHECK(strstr(Ed.statusmsg, "Recovered 1 edits") != NULL);
+
+    // each bad record on its own is refused too
+    CHECK(!editorSwapPosOk(0, 99) && !editorSwapPosOk(-1, 0) && !editorSwapPosOk(2, 1));
+    CHECK(editorSwapPosOk(0, 6) && editorSwapPosOk(2, 0));
+}
+
+// a file with another hard link is written over, both names see the edit
+void testSaveInPlace(){
+    char path[PATH_MAX], other[PATH_MAX];
+    struct ab_buf b = ab_BUF_INIT;
+    char line[32];
+    for(int i = 0; i < 100000; i++){
+        int len = snprintf(line, sizeof(line), "line %d\n", i);
+        ab_append(&b, line, len);
+    }
+    testWrite(path, "linked.txt", b.buf, b.len);
+    snprintf(other, sizeof(other), "%s/other.txt", testDir);
+    if(link(path, other) == -1) die("link");
+
+    testOpenPath(path, "");
+    CHECK(editorSaveInPlace(path));
+    testKey("X");
+    testKey("\x13");
+    CHECK(Ed.save.active);
+    // no row is copied to memory for it, only the edited one is
+    for(int i = 1; i < Ed.numRows; i++) CHECK(editorRowAt(i)->flags & ROW_MAPPED);
+    editorSaveWait();
+    CHECK(strstr(Ed.statusmsg, "bytes written") != NULL);
+    CHECK(Ed.dirty == 0);
+
+    // the rows point into the saved file again
+    CHECK(Ed.mapLen == (size_t)b.len + 1);
+    CHECK(editorRowAt(1)->flags & ROW_MAPPED);
+    CHECK(testRowIs(0, "Xline 0") && testRowIs(99999, "line 99999"));
+
+    struct stat st;
+    CHECK(stat(other, &st) == 0 && st.st_nlink == 2 && st.st_size == (off_t)b.len + 1);
+    FILE *f = fopen(other, "r");
+    CHECK(f != NULL && fgets(line, sizeof(line), f) && strcmp(line, "Xline 0\n") == 0);
+    fclose(f);
+    ab_free(&b);
+
+    // the backup, .linked.txt.XXXXXX, is gone
+    char cmd[PATH_MAX + 64];
+    snprintf(cmd, sizeof(cmd), "ls -A %s | grep -q '^\\.linked\\.txt\\.......$'", testDir);
+    CHECK(system(cmd) != 0);
+}
+
+struct testCase {
+    const char *name;
+    void (*run)();
+};
+
+struct testCase tests[] = {
+    {"paste undo", testPasteUndo},
+    {"search edit during scan", testSearchEditDuring},
+    {"search edit after scan", testSearchEditAfter},
+    {"swap replay damaged", testSwapReplayDamaged},
+    {"save in place", testSaveInPlace},
+};
+
+int main(){
+    if(mkdtemp(testDir) == NULL) die("mkdtemp");
+
+    int failed = 0, numTests = sizeof(tests) / sizeof(tests[0]);
+    for(int i = 0; i < numTests; i++){
+        // a fresh process per test, the editor keeps its state in globals
+        fflush(stdout);
+        pid_t pid = fork();
+        if(pid == -1) die("fork");
+        if(pid == 0){
+            tests[i].run();
+            editorSwapClose(1);
+            exit(0);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        printf("%s %s\n", ok ? "pass" : "FAIL", tests[i].name);
+        failed += !ok;
+    }
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", testDir);
+    if(system(cmd) != 0) printf("could not remove %s\n", testDir);
+
+    printf("%d of %d tests passed\n", numTests - failed, numTests);
+    return failed != 0;
+}
@@ -12,23 +12,264 @@
 #include <time.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /* ----- prototypes ----- */
 char *editorPrompt(char* prompt,void (*callback)(char*,int));
+char *editorPromptEmpty(char *prompt);
 void editorSetStatusMessage(char *s, ...);
+void editorIdle();
+void editorWake();
+void editorSearchFinish();
+void editorSearchPause();
+int editorSearchComplete();
+void editorSearchLaunch(int from);
+void editorSearchEdit(int y, int oldSpan, int newSpan);
+void editorSaveStart(char *filename);
+void editorSwapRecordInsert(int y, int x, const char *s, int len);
+void editorSwapRecordDelete(int sy, int sx, int ey, int ex);
+void editorSwapRecover(const char *filename);
+void editorSwapOpen(const char *filename, int mapIsBase, int withDoc);
+void editorSwapCompact();
+int editorSearchLowerBound(int y, int x);
+void editorUndoRecordInsert(int y, int x, const char *s, int len, int endY, int endX);
+void editorUndoRecordDelete(int sy, int sx, int ey, int ex);
 
 /* ----- global data ----- */
 
+/*
+    per row index of tab positions: for every tab its data index and the
+    render column right after it. between two tabs data and render columns
+    move in lockstep, so cx <-> rx is a binary search over the tabs.
+*/
+struct tabStop {
+    int cx, rx;
+};
+
+struct tabIndex {
+    int count, cap;
+    struct tabStop stop[];
+};
+
 typedef struct erow
 {
     int size;
+    int cap; // bytes allocated for data
     char *data;
     int rSize;
-    char *renderData;
+    int rCap; // bytes allocated for renderData
+    char *renderData; // built lazily, NULL until the row is drawn
+    struct tabIndex *tabs; // built lazily, NULL until first needed
 
-    int lineNo;
+    int flags;
 } erow;
- 
+
+/*
+    rows are kept in a gap buffer: one array with a hole (the gap) at the
+    last edit position. inserting/deleting at the gap is O(1), moving the
+    gap costs only the distance moved, and edits are almost always local.
+*/
+typedef struct rowBuffer
+{
+    erow *rows;
+    int cap;      // total slots in rows
+    int gapStart; // first free slot
+    int gapEnd;   // first used slot after the gap
+} rowBuffer;
+
+/*
+    background newline scan of a freshly opened file. the file is cut in
+    fixed size chunks which worker threads pick up one by one, each chunk
+    collects its own newline offsets. the input thread merges finished
+    chunks into rows, in file order, whenever it is idle.
+*/
+struct indexChunk {
+    size_t start, end;     // byte range of the file
+    uint32_t *nl;          // newline offsets, relative to start
+    int count, cap;
+    atomic_int done;
+};
+
+struct lineIndex {
+    int active;
+    char *base;
+    size_t len;
+    size_t lineStart;      // start of the line that is not merged yet
+
+    struct indexChunk *chunks;
+    int numChunks;
+    int merged;            // chunks already turned into rows
+    atomic_int nextChunk;  // next chunk for a worker to pick
+    atomic_long linesFound;
+    int baseRows;          // rows indexed before the workers started
+
+    pthread_t *threads;
+    int numThreads;
+};
+
+/*
+    search runs on worker threads over the raw row data. rows are cut in
+    chunks of SEARCH_CHUNK_ROWS, workers take chunks one by one and collect
+    the matches of each chunk on their own. the input thread merges
+    finished chunks in row order, so matches always come out in document
+    order and the first ones are usable before the scan is over.
+*/
+struct searchMatch {
+    int y, x; // row and data index of the match
+    int len;
+};
+
+struct searchChunk {
+    int start, end; // rows [start,end)
+    struct searchMatch *m;
+    int count, cap;
+    atomic_int done;
+};
+
+struct searchState {
+    int active;    // workers are running
+    int regex;     // query is a regex, not a literal
+    char *query;
+    int qlen;
+    struct regex *re;        // compiled query in regex mode, NULL if invalid
+    struct reMatcher *match; // for rows rescanned on the input thread
+
+    struct searchChunk *chunks;
+    int numChunks;
+    int merged;    // chunks already moved to matches
+    int resumeFrom; // a paused scan goes on from this row, -1 if not paused
+    atomic_int nextChunk;
+    atomic_int cancel;
+
+    pthread_t *threads;
+    int numThreads;
+
+    // the match index: every (overlapping) match merged so far, in
+    // document order. it outlives the prompt, edits patch it row by row
+    // and it is dropped on Esc.
+    struct searchMatch *matches;
+    int numMatches, capMatches;
+    int jumped;    // cursor was moved to a match of this query
+    int originY, originX; // first jump goes to the first match from here
+};
+
+/*
+    background save. the document is snapshotted as one iovec per row,
+    pointing at the row data as it is now, and a thread writes that out.
+    owned row buffers are marked ROW_SHARED for the duration: an edit
+    copies such a row first, and buffers that would be freed are kept
+    until the writer is done, so the snapshot never changes under it.
+*/
+struct saveJob {
+    int active;
+    char *filename;
+    struct iovec *lines;
+    int numLines;
+    long long total;       // bytes to write
+    atomic_llong written;
+    atomic_int done;
+    long long result;      // bytes written, -1 on error
+    int err;
+    int dirtyAtStart;
+    int inPlace;           // file is written over instead of replaced, see editorSaveInPlace
+    char *backup;          // in place: temp file with the new text, kept if the write fails
+    int copying;           // in place: the backup is being copied over the file
+
+    char **deferred;       // row buffers to free once the writer is done
+    int numDeferred, capDeferred;
+
+    pthread_t thread;
+};
+
+/*
+    undo journal. every edit is one op: text inserted at or deleted from a
+    position, the text itself lives in one growing arena. ops of the same
+    group are undone/redone together, consecutive keystrokes coalesce
+    into one op (typing) or one group (backspace).
+*/
+#define UNDO_INSERT 1
+#define UNDO_DELETE 2
+
+struct undoOp {
+    int type;
+    int group;
+    int y, x;        // where the text starts
+    int endY, endX;  // where it ends
+    size_t text;     // offset of the text in the arena
+    int len;
+    int cy, cx;      // cursor before the edit
+};
+
+struct undoLog {
+    struct undoOp *ops;
+    int numOps, capOps;
+    int applied;     // ops [0,applied) are done, the rest can be redone
+
+    char *arena;
+    size_t arenaLen, arenaCap;
+
+    int group;       // group id of the last op
+    int keySeq;      // key that made the last op, for coalescing
+    int lostSeq;     // key whose group did not fit, the rest of it isnt kept
+    int replaying;   // set while undo/redo edits the file
+};
+
+// append buffer, output is collected here and written at once
+struct ab_buf {
+    char *buf;
+    int len;
+    int cap;
+};
+
+/*
+    keyboard input. whatever the terminal has sent is drained into buf
+    with one read and keys are decoded from there, so a burst of keys
+    costs one syscall and one frame instead of one of each per byte.
+*/
+#define INPUT_BUF_SIZE (64 << 10)
+
+struct inputBuffer {
+    char buf[INPUT_BUF_SIZE];
+    int start, len; // bytes not decoded yet: buf[start, start+len)
+    int wake[2];    // pipe worker threads write to, ends a poll early
+};
+
+// swap file of the open file, see the swap file section
+struct swapFile {
+    int active;
+    char *path;
+    int fd;          // owned by the writer thread
+
+    pthread_t thread;
+    pthread_mutex_t lock;  // guards the fields up to quit
+    pthread_cond_t wake;
+    struct ab_buf pending; // records not written yet
+    char *compact;         // replaces the file contents when set
+    size_t compactLen;
+    struct swapHeader {
+        char magic[11];
+        int64_t size;
+        int64_t mtime, mtimeNsec;
+    } header;
+    int quit;
+
+    long long journalLen;  // record bytes since the last compaction
+    long long lastCompact; // size of the last compaction
+    int wantCompact;
+    int mapIsBase;         // Ed.map is the file named in the header
+    int off;               // a swap file we must not write over is in the way
+};
 
 struct editorConfig {
     int START;
@@ -40,9 +281,24 @@ struct editorConfig {
 
     // stores file data
     int numRows;
-    erow *row;
+    rowBuffer row;
     char *filename; 
 
+    // opened file mapped into memory, unedited rows point straight into it
+    char *map;
+    size_t mapLen;
+    struct lineIndex index;
+
+    // last frame written to the terminal, one entry per screen line
+    // (text rows + status bar + message bar), to redraw only what changed
+    struct ab_buf *frame;
+    int frameLines;
+    int frameScrollY; // scrollYOffset the frame was drawn with
+    int frameValid;
+    struct ab_buf out;     // frame being sent to the terminal
+    int outFd;             // where frames are written, the terminal unless headless
+    struct ab_buf scratch; // line being drawn
+
     int scrollYOffset; // vertical scroll offset
     int scrollXOffset; // horizontal scroll offset
 
@@ -50,18 +306,26 @@ struct editorConfig {
     char statusmsg[80];
     time_t statusmsg_time;
 
-    // to keep track of unsaved changes
+    // to keep track of unsaved changes, counts edits so a background save
+    // can tell whether anything changed while it was writing
     int dirty;
+    struct saveJob save;
+    struct swapFile swap;
 
     // to keep track of selected text
     int selected;
-    int sx,sy,ex,ey; // cords of selection
-    char* selectedData;
-    int selectedDataLen;
+    int sx,sy,ex,ey; // cords of selection, text is only copied out on Ctrl-C
     
     int copied;
     char* copiedData;
     int copiedDataLen;
+
+    struct undoLog undo;
+    int keySeq; // counts processed keys
+
+    struct searchState search;
+
+    struct inputBuffer in;
 };
 
 struct editorConfig Ed;
@@ -69,11 +333,27 @@ struct editorConfig Ed;
 /* ----- defines ----- */
 
 #define CTRL_KEY(k) ((k) & 0x1f)  // 11111
-#define ab_BUF_INIT {NULL, 0}
+#define ab_BUF_INIT {NULL, 0, 0}
 #define TEXTER_VERSION "0.0.1"
 #define TAB_SIZE 4
+// render column a tab starting at rx ends at (tab stops every TAB_SIZE+1)
+#define NEXT_TAB_STOP(rx) ((rx) + (TAB_SIZE + 1) - (rx) % (TAB_SIZE + 1))
 #define TEXTER_QUIT_CONFIRM 2
 #define STATUS_DISPLAY_TIME 1
+#define INDEX_CHUNK_SIZE (16 << 20) // bytes of file per indexing job
+#define SEARCH_CHUNK_ROWS 16384 // rows per search job
+#define UNDO_LIMIT (64 << 20) // bytes of undo text and ops kept, oldest groups go first
+#define UNDO_TRIM_TO (UNDO_LIMIT / 4 * 3) // size a full journal is trimmed down to
+#define ROW_MAPPED 1 // row data points into Ed.map, not owned and read-only
+#define ROW_SHARED 2 // row data is in a save snapshot, copy before changing it
+#define ESC_TIMEOUT_MS 50 // wait for the rest of an escape sequence, else it is the Esc key
+#define ESC_MAX_PARAMS 16 // longest parameter list of an escape sequence we accept
+#define KEY_INCOMPLETE -1 // editorDecodeKey: the key has not fully arrived, not a byte value
+#define IDLE_TICK_MS 100 // poll timeout while background work shows progress
+#define FRAME_MIN_MS 0 // least time between frames while keys keep coming, 0: no cap
+#define PASTE_END "\x1b[201~" // closes a bracketed paste
+#define PASTE_TIMEOUT_MS 1000 // a paste that stalls this long is taken as ended
+#define CURSOR_REPLY_TIMEOUT_MS 1000 // terminal that does not answer the cursor query by then won't
 // [for colors check ANSI color codes]
 
 enum editorKey {
@@ -91,25 +371,315 @@ enum editorKey {
     SHIFT_ARROW_DOWN,
     SHIFT_ARROW_RIGHT,
     SHIFT_ARROW_LEFT,
+    PASTE_START, // "\x1b[200~", pasted text follows up to PASTE_END
 };
 
 /* ----- DEBUG functions ----- */
 
-void debugLog(const char *format, ...) {
-    FILE *logFile = fopen("debug_log.txt", "a"); // Append mode to keep previous logs
-    if (logFile == NULL) {
-        return; // If the file can't be opened, exit the function
+/*
+    tracing. compiled in with -DTEXTER_TRACE, and then only recording when
+    TEXTER_TRACE=<file> is set in the environment. events go into a fixed
+    ring in memory, any thread adds one with a single atomic increment and
+    no lock. the ring is written to the file at exit, or on SIGUSR1.
+    without the flag TRACE() compiles to nothing.
+*/
+#ifdef TEXTER_TRACE
+
+#define TRACE_RING_SIZE (1 << 16) // events kept, must be a power of two
+
+struct traceEvent {
+    long long ns;       // CLOCK_MONOTONIC
+    const char *name;   // string literal
+    long long a, b;
+    int thread;
+    atomic_ullong seq;  // event number + 1, once the event is complete
+};
+
+struct traceRing {
+    int on;
+    const char *path;
+    long long startNs;
+    atomic_ullong head;     // events recorded so far
+    unsigned long long flushed;
+    atomic_int nextThread;
+    volatile sig_atomic_t wantFlush;
+    struct traceEvent ev[TRACE_RING_SIZE];
+};
+
+struct traceRing Trace;
+_Thread_local int traceThread; // 0 until the thread records its first event
+
+#define TRACE(name, a, b) do{ if(Trace.on) traceEvent((name), (a), (b)); }while(0)
+
+long long traceNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void traceEvent(const char *name, long long a, long long b){
+    unsigned long long n = atomic_fetch_add_explicit(&Trace.head, 1, memory_order_relaxed);
+    struct traceEvent *e = &Trace.ev[n & (TRACE_RING_SIZE - 1)];
+
+    if(traceThread == 0) traceThread = atomic_fetch_add(&Trace.nextThread, 1) + 1;
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    e->ns = traceNow();
+    e->name = name;
+    e->a = a;
+    e->b = b;
+    e->thread = traceThread;
+    atomic_store_explicit(&e->seq, n + 1, memory_order_release);
+}
+
+// appends the events recorded since the last flush to the trace file
+void traceFlush(){
+    if(!Trace.on) return;
+    Trace.wantFlush = 0;
+
+    FILE *f = fopen(Trace.path, "a");
+    if(f == NULL) return;
+
+    unsigned long long head = atomic_load(&Trace.head);
+    unsigned long long from = Trace.flushed;
+    if(head - from > TRACE_RING_SIZE){
+        fprintf(f, "# %llu events overwritten\n", head - from - TRACE_RING_SIZE);
+        from = head - TRACE_RING_SIZE;
+    }
+    for(unsigned long long n = from; n < head; n++){
+        struct traceEvent *e = &Trace.ev[n & (TRACE_RING_SIZE - 1)];
+        if(atomic_load_explicit(&e->seq, memory_order_acquire) != n + 1) continue; // still being written
+        long long us = (e->ns - Trace.startNs) / 1000;
+        fprintf(f, "%lld.%06lld %d %s %lld %lld\n", us / 1000000, us % 1000000, e->thread, e->name, e->a, e->b);
+    }
+    Trace.flushed = head;
+    fclose(f);
+}
+
+void traceSignal(int sig){
+    (void)sig;
+    Trace.wantFlush = 1; // the input thread flushes when it is idle
+}
+
+void traceInit(){
+    Trace.path = getenv("TEXTER_TRACE");
+    if(Trace.path == NULL || Trace.path[0] == '\0') return;
+
+    FILE *f = fopen(Trace.path, "w"); // a fresh trace per run
+    if(f == NULL) return;
+    fprintf(f, "# seconds thread event a b\n");
+    fclose(f);
+
+    Trace.startNs = traceNow();
+    Trace.on = 1;
+    traceThread = atomic_fetch_add(&Trace.nextThread, 1) + 1;
+    atexit(traceFlush);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = traceSignal;
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+#define traceIdle() do{ if(Trace.wantFlush) traceFlush(); }while(0)
+
+#else
+
+#define TRACE(name, a, b) do{}while(0)
+#define traceInit() do{}while(0)
+#define traceIdle() do{}while(0)
+
+#endif
+
+/*
+    profiler, compiled in with -DTEXTER_PROFILE. times the stages of every
+    key: reading it, the edit, assembling the frame and writing it, and the
+    latency from input arriving to the frame that shows it, next to bytes
+    and allocations per frame. every stat keeps its last PROF_WINDOW
+    samples for rolling percentiles. Ctrl-P shows them in the message bar,
+    TEXTER_PROFILE=<file> dumps them to the file at exit.
+*/
+#ifdef TEXTER_PROFILE
+
+#define PROF_WINDOW 512 // samples the percentiles are taken over
+
+enum profStat {
+    PROF_READ, PROF_EDIT, PROF_DRAW, PROF_WRITE, PROF_FRAME, PROF_LATENCY,
+    PROF_BYTES, PROF_ALLOCS,
+    PROF_STATS
+};
+
+const char *profNames[PROF_STATS] = {
+    "read us", "edit us", "draw us", "write us", "frame us", "latency us",
+    "bytes", "allocs"
+};
+
+struct profSeries {
+    long long v[PROF_WINDOW]; // last samples, v[count % PROF_WINDOW] is next
+    long long count, sum, max;
+};
+
+struct profiler {
+    struct profSeries s[PROF_STATS];
+    int overlay;
+    long long readAt;    // editorReadKey had input to work with
+    long long keyAt;     // editorReadKey returned the current key
+    long long inputAt;   // oldest input not on screen yet, 0 if none
+    long long frameAt, drawnAt;
+    long long allocsAtFrame;
+};
+
+struct profiler Prof;
+_Thread_local long long profAllocs; // only the input thread's count is used
+
+long long profNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+void profAdd(int stat, long long v){
+    struct profSeries *s = &Prof.s[stat];
+    s->v[s->count % PROF_WINDOW] = v;
+    s->count++;
+    s->sum += v;
+    if(v > s->max) s->max = v;
+}
+
+int profCompare(const void *a, const void *b){
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// rolling percentile of a stat, over its last PROF_WINDOW samples
+long long profPercentile(int stat, int pct){
+    struct profSeries *s = &Prof.s[stat];
+    long long v[PROF_WINDOW];
+    int n = s->count < PROF_WINDOW ? s->count : PROF_WINDOW;
+
+    if(n == 0) return 0;
+    memcpy(v, s->v, sizeof(long long) * n);
+    qsort(v, n, sizeof(long long), profCompare);
+    return v[(n - 1) * pct / 100];
+}
+
+void profReadStart(){
+    Prof.readAt = profNow();
+}
+
+void profReadEnd(){
+    Prof.keyAt = profNow();
+    profAdd(PROF_READ, Prof.keyAt - Prof.readAt);
+}
+
+void profInput(){
+    if(Prof.inputAt == 0) Prof.inputAt = profNow();
+}
+
+void profEditEnd(){
+    profAdd(PROF_EDIT, profNow() - Prof.keyAt);
+}
+
+void profFrameStart(){
+    Prof.frameAt = profNow();
+}
+
+void profFrameDrawn(){
+    Prof.drawnAt = profNow();
+}
+
+void profFrameEnd(int bytes){
+    long long now = profNow();
+
+    profAdd(PROF_DRAW, Prof.drawnAt - Prof.frameAt);
+    profAdd(PROF_WRITE, now - Prof.drawnAt);
+    profAdd(PROF_FRAME, now - Prof.frameAt);
+    profAdd(PROF_BYTES, bytes);
+    profAdd(PROF_ALLOCS, profAllocs - Prof.allocsAtFrame);
+    Prof.allocsAtFrame = profAllocs;
+    if(Prof.inputAt){
+        profAdd(PROF_LATENCY, now - Prof.inputAt);
+        Prof.inputAt = 0;
+    }
+}
+
+void profToggleOverlay(){
+    Prof.overlay = !Prof.overlay;
+}
+
+// the overlay line, p50/p99 of each stat. returns 0 while it is off
+int profFormat(char *buf, int len){
+    if(!Prof.overlay) return 0;
+
+    int n = snprintf(buf, len, "p50/p99 read %lld/%lld edit %lld/%lld draw %lld/%lld write %lld/%lld lat %lld/%lldus | %lld/%lldB %lld/%lld allocs",
+        profPercentile(PROF_READ, 50), profPercentile(PROF_READ, 99),
+        profPercentile(PROF_EDIT, 50), profPercentile(PROF_EDIT, 99),
+        profPercentile(PROF_DRAW, 50), profPercentile(PROF_DRAW, 99),
+        profPercentile(PROF_WRITE, 50), profPercentile(PROF_WRITE, 99),
+        profPercentile(PROF_LATENCY, 50), profPercentile(PROF_LATENCY, 99),
+        profPercentile(PROF_BYTES, 50), profPercentile(PROF_BYTES, 99),
+        profPercentile(PROF_ALLOCS, 50), profPercentile(PROF_ALLOCS, 99));
+    return n < len ? n : len - 1;
+}
+
+void profDump(){
+    FILE *f = fopen(getenv("TEXTER_PROFILE"), "w");
+    if(f == NULL) return;
+
+    fprintf(f, "%-12s %10s %10s %10s %10s %10s\n", "stat", "samples", "p50", "p99", "mean", "max");
+    for(int i = 0; i < PROF_STATS; i++){
+        struct profSeries *s = &Prof.s[i];
+        fprintf(f, "%-12s %10lld %10lld %10lld %10lld %10lld\n", profNames[i], s->count,
+            profPercentile(i, 50), profPercentile(i, 99), s->count ? s->sum / s->count : 0, s->max);
     }
+    fprintf(f, "# p50/p99 over the last %d samples, mean/max over the whole run\n", PROF_WINDOW);
+    fclose(f);
+}
 
-    va_list args;
-    va_start(args, format);
-    vfprintf(logFile, format, args);
-    va_end(args);
+void profInit(){
+    char *path = getenv("TEXTER_PROFILE");
+    if(path && path[0]) atexit(profDump);
+}
+
+// allocations are counted through these, everything below uses them
+void *profMalloc(size_t n){
+    profAllocs++;
+    return malloc(n);
+}
+
+void *profCalloc(size_t n, size_t size){
+    profAllocs++;
+    return calloc(n, size);
+}
+
+void *profRealloc(void *p, size_t n){
+    profAllocs++;
+    return realloc(p, n);
+}
 
-    fprintf(logFile, "\n"); // Add a new line after each log
-    fclose(logFile);
+char *profStrdup(const char *s){
+    profAllocs++;
+    return strdup(s);
 }
 
+#define malloc(n) profMalloc(n)
+#define calloc(n, size) profCalloc((n), (size))
+#define realloc(p, n) profRealloc((p), (n))
+#define strdup(s) profStrdup(s)
+
+#else
+
+#define profInit() do{}while(0)
+#define profReadStart() do{}while(0)
+#define profReadEnd() do{}while(0)
+#define profInput() do{}while(0)
+#define profEditEnd() do{}while(0)
+#define profFrameStart() do{}while(0)
+#define profFrameDrawn() do{}while(0)
+#define profFrameEnd(bytes) do{}while(0)
+#define profFormat(buf, len) ((void)(buf), 0)
+
+#endif
+
 
 /* ----- terminal functions ----- */
 
@@ -135,6 +705,8 @@ void die(const char* s){
 }
 
 void disableRawMode() {
+    write(STDOUT_FILENO, "\x1b[?2004l", 8); // bracketed paste off
+
     // to apply terminal setting for standard input (STDIN_FILENO) to original state.
   if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &Ed.orig_termios) == -1){
     die("tcsetattr");
@@ -178,98 +750,216 @@ void enableRawMode() {
     raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN); 
     raw.c_cflag |= (CS8);
 
+    // read() returns what is there right away, poll() does the waiting
     raw.c_cc[VMIN] = 0; // minimum #bits needed before read() can return
-    raw.c_cc[VTIME] = 50; // total input time window before read() return 0 (in 1/10 th of seconds).
+    raw.c_cc[VTIME] = 0; // total input time window before read() return 0 (in 1/10 th of seconds).
 
     // to apply terminal setting for standard input (STDIN_FILENO) to content of raw
     // TCSAFLUSH: this option flushes any ip/op present and immediately apply new terminal attr!
     if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1){
         die("tcsetattr");
     } 
+
+    // bracketed paste: the terminal wraps pasted text in "\x1b[200~" and
+    // "\x1b[201~", so a paste is one insert instead of a key per byte
+    write(STDOUT_FILENO, "\x1b[?2004h", 8);
 }
 
-int editorReadKey() {
-    int readn;
-    char c;
+long long editorNowMs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
 
-    // Read a character from stdin
-    while ((readn = read(STDIN_FILENO, &c, 1)) != 1) {
-        if (readn == -1 && errno != EAGAIN) {
-            die("read");
+// wakes the input thread out of poll, called by workers with news for editorIdle
+void editorWake(){
+    if(Ed.in.wake[1] > 0){
+        char c = 1;
+        if(write(Ed.in.wake[1], &c, 1) == -1){
+            // pipe is full, the input thread is woken up already
         }
     }
+}
+
+/*
+    waits up to timeout ms (-1: no limit) for input or a wakeup, then
+    drains everything the terminal has into Ed.in. returns the number of
+    bytes read.
+*/
+int editorReadInput(int timeout){
+    struct inputBuffer *in = &Ed.in;
+    struct pollfd fds[2];
+    int n = 0;
+
+    fds[n].fd = STDIN_FILENO;
+    fds[n++].events = POLLIN;
+    if(in->wake[0] > 0){
+        fds[n].fd = in->wake[0];
+        fds[n++].events = POLLIN;
+    }
 
-    // Handle escape sequences
-    if (c == '\x1b') {
-        char seq[3];
+    if(poll(fds, n, timeout) == -1){
+        if(errno == EINTR) return 0;
+        die("poll");
+    }
+    if(n > 1 && (fds[1].revents & POLLIN)){
+        char drain[64];
+        while(read(in->wake[0], drain, sizeof(drain)) > 0);
+    }
+    if(!(fds[0].revents & POLLIN)) return 0;
 
-        // Try reading the next two characters to detect escape sequences
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+    if(in->start > 0){
+        memmove(in->buf, in->buf + in->start, in->len);
+        in->start = 0;
+    }
+    if(in->len == INPUT_BUF_SIZE) return 0;
 
-        // Handling escape sequences for special keys
+    int readn = read(STDIN_FILENO, in->buf + in->len, INPUT_BUF_SIZE - in->len);
+    if(readn == -1){
+        if(errno == EAGAIN || errno == EINTR) return 0;
+        die("read");
+    }
+    in->len += readn;
+    TRACE("input", readn, in->len);
+    if(readn > 0) profInput();
+    return readn;
+}
 
-        if (seq[0] == '[') {
-    
-            if (seq[1] >= '0' && seq[1] <= '9') {
-                // Read the next part of the escape sequence
-                char seq2[3];
-                if (read(STDIN_FILENO, &seq2[0], 1) != 1) return '\x1b';
-                    
-                
-                // Check if it's a Shift+Arrow key
-                if (seq2[0] == ';') {
-                    if (read(STDIN_FILENO, &seq2[1], 1) != 1) return '\x1b';
-                
-
-                    if (seq2[1] == '2') {  // "2" indicates Shift key
-                        if (read(STDIN_FILENO, &seq2[2], 1) != 1) return '\x1b';
-
-                            
-                        // editorSetStatusMessage("%3s",seq2);
-
-                        // Map SHIFT+Arrow keys
-                        switch (seq2[2]) {
-                            case 'A': return SHIFT_ARROW_UP;
-                            case 'B': return SHIFT_ARROW_DOWN;
-                            case 'C': return SHIFT_ARROW_RIGHT;
-                            case 'D': return SHIFT_ARROW_LEFT;
-                        }
-                    }
-                } else if (seq2[0] == '~') {
-                    // Page up/down, home, end, and delete
-                    switch (seq[1]) {
-                        case '1': return HOME_KEY;
-                        case '4': return END_KEY;
-                        case '3': return DEL_KEY;
-                        case '5': return PAGE_UP;
-                        case '6': return PAGE_DOWN;
-                        case '7': return HOME_KEY;
-                        case '8': return END_KEY;
-                    }
-                }
-            } else {
-                // Handle simple arrow keys
-                switch (seq[1]) {
-                    case 'A': return ARROW_UP;
-                    case 'B': return ARROW_DOWN;
-                    case 'C': return ARROW_RIGHT;
-                    case 'D': return ARROW_LEFT;
-                    case 'H': return HOME_KEY;
-                    case 'F': return END_KEY;
-                }
-            }
-        } else if (seq[0] == 'O') {
-            switch (seq[1]) {
-                case 'H': return HOME_KEY;
-                case 'F': return END_KEY;
+/*
+    decodes the key at the front of s, *used is set to the bytes it takes.
+    plain bytes come back as 0..255. returns KEY_INCOMPLETE when s ends
+    inside an escape sequence, the rest of it may still be on the way.
+*/
+int editorDecodeKey(const char *s, int len, int *used){
+    if(len == 0) return KEY_INCOMPLETE;
+
+    *used = 1;
+    if(s[0] != '\x1b') return (unsigned char)s[0];
+
+    if(len < 2) return KEY_INCOMPLETE;
+    if(s[1] == 'O'){
+        if(len < 3) return KEY_INCOMPLETE;
+        *used = 3;
+        switch (s[2]) {
+            case 'H': return HOME_KEY;
+            case 'F': return END_KEY;
+        }
+        return '\x1b';
+    }
+    if(s[1] != '['){
+        *used = 2; // alt + key, not bound to anything
+        return '\x1b';
+    }
+
+    // "\x1b[", parameter bytes, then one final byte
+    int i = 2;
+    while(i < len && i - 2 < ESC_MAX_PARAMS && s[i] >= 0x30 && s[i] <= 0x3f) i++;
+    if(i - 2 == ESC_MAX_PARAMS){
+        *used = i; // garbage, drop it
+        return '\x1b';
+    }
+    if(i == len) return KEY_INCOMPLETE;
+    *used = i + 1;
+
+    const char *p = s + 2;
+    int plen = i - 2;
+    char fin = s[i];
+
+    if(fin == '~' && plen == 3 && memcmp(p, "200", 3) == 0){
+        return PASTE_START;
+    } else if(fin == '~' && plen == 1){
+        // Page up/down, home, end, and delete
+        switch (p[0]) {
+            case '1': return HOME_KEY;
+            case '4': return END_KEY;
+            case '3': return DEL_KEY;
+            case '5': return PAGE_UP;
+            case '6': return PAGE_DOWN;
+            case '7': return HOME_KEY;
+            case '8': return END_KEY;
+        }
+    } else if(plen == 0){
+        // Handle simple arrow keys
+        switch (fin) {
+            case 'A': return ARROW_UP;
+            case 'B': return ARROW_DOWN;
+            case 'C': return ARROW_RIGHT;
+            case 'D': return ARROW_LEFT;
+            case 'H': return HOME_KEY;
+            case 'F': return END_KEY;
+        }
+    } else if(plen == 3 && p[1] == ';' && p[2] == '2'){
+        // "2" indicates Shift key
+        switch (fin) {
+            case 'A': return SHIFT_ARROW_UP;
+            case 'B': return SHIFT_ARROW_DOWN;
+            case 'C': return SHIFT_ARROW_RIGHT;
+            case 'D': return SHIFT_ARROW_LEFT;
+        }
+    }
+
+    return '\x1b'; // Return escape character if it's not a recognized sequence
+}
+
+// background work that wants the screen updated while nothing is typed
+int editorBusy(){
+    return Ed.index.active || Ed.search.active || Ed.save.active;
+}
+
+int editorReadKey() {
+    struct inputBuffer *in = &Ed.in;
+    int used, c;
+    long long escDeadline = -1;
+
+    profReadStart();
+    while ((c = editorDecodeKey(in->buf + in->start, in->len, &used)) == KEY_INCOMPLETE) {
+        if (in->len > 0) {
+            // stuck inside an escape sequence: the rest arrives right
+            // behind it, unless this was the Esc key on its own
+            long long now = editorNowMs();
+            if (escDeadline == -1) escDeadline = now + ESC_TIMEOUT_MS;
+            if (now >= escDeadline) {
+                c = '\x1b';
+                used = in->len;
+                break;
             }
+            editorReadInput(escDeadline - now);
+        } else {
+            editorIdle(); // no key yet, catch up with background work
+            editorReadInput(editorBusy() ? IDLE_TICK_MS : -1);
         }
+        profReadStart(); // time spent waiting is not reading
+    }
+
+    in->start += used;
+    in->len -= used;
+    profReadEnd();
+    return c;
+}
 
-        return '\x1b'; // Return escape character if it's not a recognized sequence
+// queues input as if the terminal had sent it, for headless drivers.
+// returns the bytes that fit
+int editorFeedInput(const char *s, int len){
+    struct inputBuffer *in = &Ed.in;
+
+    if(in->start > 0){
+        memmove(in->buf, in->buf + in->start, in->len);
+        in->start = 0;
     }
+    if(len > INPUT_BUF_SIZE - in->len) len = INPUT_BUF_SIZE - in->len;
+    memcpy(in->buf + in->len, s, len);
+    in->len += len;
+    return len;
+}
 
-    return c;  // Return the character read if it's not an escape sequence
+// a whole key has arrived already, checked without blocking
+int editorKeyPending() {
+    struct inputBuffer *in = &Ed.in;
+    int used;
+
+    if (editorDecodeKey(in->buf + in->start, in->len, &used) != KEY_INCOMPLETE) return 1;
+    editorReadInput(0);
+    return editorDecodeKey(in->buf + in->start, in->len, &used) != KEY_INCOMPLETE;
 }
 
 
@@ -282,6 +972,9 @@ int getCursorPosition(int *rows, int *cols){
     unsigned int i = 0;
 
     while (i < sizeof(buf) - 1) {
+        // stdin does not block in raw mode, wait for the reply to come in
+        struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        if (poll(&pfd, 1, CURSOR_REPLY_TIMEOUT_MS) <= 0) break;
         if (read(STDIN_FILENO, &buf[i], 1) != 1) break;
         if (buf[i] == 'R') break;
         i++;
@@ -329,54 +1022,222 @@ int getWindowSize(int *rows, int *cols) {
 
 /* -----  append buffer  ----- */
 
-struct ab_buf {
-    char *buf;
-    int len;
-};
+/*
+    buffers live across frames: capacity doubles when it runs out and
+    ab_reset only rewinds len, so after the first few frames building a
+    frame does not allocate at all.
+*/
 
-void ab_append(struct ab_buf *b, char *s, int len){
-    char *temp = realloc(b->buf, b->len+len); // temp has larger mem block with initial data same as b->buf.
-    if (temp==NULL) return;
+// makes room for at least need more bytes
+void ab_grow(struct ab_buf *b, int need){
+    int cap = b->cap ? b->cap : 256;
+    while(cap < b->len + need) cap *= 2;
 
-    memcpy(&temp[b->len],s,len); // now taking s to back of temp string.
+    char *temp = realloc(b->buf, cap); // temp has larger mem block with initial data same as b->buf.
+    if (temp==NULL) die("realloc");
 
     b->buf = temp;
-    b->len = b->len + len; 
+    b->cap = cap;
+}
+
+void ab_append(struct ab_buf *b, const char *s, int len){
+    if(b->len + len > b->cap) ab_grow(b, len);
+
+    memcpy(&b->buf[b->len],s,len); // now taking s to back of buf.
+    b->len += len; 
+}
+
+void ab_appendc(struct ab_buf *b, char c){
+    if(b->len == b->cap) ab_grow(b, 1);
+    b->buf[b->len++] = c;
+}
+
+// for escape codes and other string literals, length known at compile time
+#define ab_appendLit(b, s) ab_append((b), (s), sizeof(s) - 1)
+
+// appends the cursor position escape code "\x1b[row;colH", without snprintf
+void ab_appendCursor(struct ab_buf *b, int row, int col){
+    char buf[32];
+    int len = 0;
+    int nums[2] = {row, col};
+
+    buf[len++] = '\x1b';
+    buf[len++] = '[';
+    for(int k=0;k<2;k++){
+        char digits[12];
+        int n = nums[k] < 1 ? 1 : nums[k], d = 0;
+        while(n){ digits[d++] = '0' + n % 10; n /= 10; }
+        while(d) buf[len++] = digits[--d];
+        buf[len++] = k ? 'H' : ';';
+    }
+    ab_append(b, buf, len);
+}
+
+void ab_reset(struct ab_buf *b) {
+    b->len = 0;
 }
 
 void ab_free(struct ab_buf *b) {
     free(b->buf);
+    b->buf = NULL;
+    b->len = b->cap = 0;
+}
+
+/* ----- row storage ----- */
+
+erow *editorRowAt(int idx){
+    rowBuffer *rb = &Ed.row;
+    if(idx >= rb->gapStart) idx += rb->gapEnd - rb->gapStart;
+    return &rb->rows[idx];
+}
+
+void editorRowBufferMoveGap(int idx){
+    rowBuffer *rb = &Ed.row;
+    int gap = rb->gapEnd - rb->gapStart;
+
+    if(idx < rb->gapStart){ // shift rows [idx,gapStart) to after the gap
+        int n = rb->gapStart - idx;
+        memmove(&rb->rows[rb->gapEnd - n], &rb->rows[idx], sizeof(erow) * n);
+    }else if(idx > rb->gapStart){ // shift rows after the gap to before it
+        int n = idx - rb->gapStart;
+        memmove(&rb->rows[rb->gapStart], &rb->rows[rb->gapEnd], sizeof(erow) * n);
+    }
+    rb->gapStart = idx;
+    rb->gapEnd = idx + gap;
+}
+
+// makes sure at least n slots are free in the gap
+void editorRowBufferReserve(int n){
+    rowBuffer *rb = &Ed.row;
+    if(rb->gapEnd - rb->gapStart >= n) return;
+
+    int newCap = rb->cap ? rb->cap * 2 : 64;
+    while(newCap - Ed.numRows < n) newCap *= 2;
+
+    erow *rows = malloc(sizeof(erow) * newCap);
+    if(rows == NULL) die("malloc");
+
+    int tail = rb->cap - rb->gapEnd;
+    memcpy(rows, rb->rows, sizeof(erow) * rb->gapStart);
+    memcpy(&rows[newCap - tail], &rb->rows[rb->gapEnd], sizeof(erow) * tail);
+    free(rb->rows);
+
+    rb->rows = rows;
+    rb->gapEnd = newCap - tail;
+    rb->cap = newCap;
+}
+
+// opens a slot for a new row at idx and returns it (uninitialised)
+erow *editorRowBufferInsert(int idx){
+    editorRowBufferReserve(1);
+    editorRowBufferMoveGap(idx);
+
+    Ed.numRows++;
+    return &Ed.row.rows[Ed.row.gapStart++];
+}
+
+// drops count rows starting at idx from the buffer, the caller frees their data
+void editorRowBufferDelete(int idx, int count){
+    editorRowBufferMoveGap(idx);
+    Ed.row.gapEnd += count;
+    Ed.numRows -= count;
 }
 
 /* ----- row operations ----- */
 
-int editorCxToRx(erow *line, int cx){
-    int rx = 0;
-    for(int i=0;i<cx;i++){
-        if(line->data[i]=='\t'){
-            // since all tabs dont take full TAB_SIZE,
-            // we decrease that part.
-            rx += TAB_SIZE - rx%(TAB_SIZE+1); 
-        }
-        rx++;
+// makes sure the tab index can hold n stops
+void editorTabIndexReserve(erow *line, int n){
+    struct tabIndex *ti = line->tabs;
+    if(ti && ti->cap >= n) return;
+
+    int cap = ti && ti->cap ? ti->cap : 4;
+    while(cap < n) cap *= 2;
+
+    ti = realloc(ti, sizeof(struct tabIndex) + sizeof(struct tabStop) * cap);
+    if(ti == NULL) die("realloc");
+    if(line->tabs == NULL) ti->count = 0;
+    ti->cap = cap;
+    line->tabs = ti;
+}
+
+// returns the row's tab index, scanning the row for tabs on first use
+struct tabIndex *editorTabIndex(erow *line){
+    if(line->tabs) return line->tabs;
+
+    editorTabIndexReserve(line, 0);
+    struct tabIndex *ti = line->tabs;
+
+    int rx = 0, i = 0;
+    char *tab;
+    while((tab = memchr(&line->data[i], '\t', line->size - i)) != NULL){
+        // since all tabs dont take full TAB_SIZE,
+        // we jump to the next tab stop.
+        rx = NEXT_TAB_STOP(rx + (int)(tab - &line->data[i]));
+        i = tab - line->data + 1;
+
+        editorTabIndexReserve(line, line->tabs->count + 1);
+        ti = line->tabs;
+        ti->stop[ti->count].cx = i - 1;
+        ti->stop[ti->count].rx = rx;
+        ti->count++;
     }
-    return rx+GetLineNoBarWidth();
+    return ti;
 }
 
-int editorRxToCx(erow *line, int rx) {
-    int cx = 0, tmprx = 0;
-    
-    for(int i=0;tmprx<rx;i++){
-        if(line->data[i]=='\t'){
-            // since all tabs dont take full TAB_SIZE,
-            // we decrease that part.
-            tmprx += TAB_SIZE - tmprx%(TAB_SIZE+1); 
-        }
-        cx++;
-        tmprx++;
+// number of tabs in the row before data index cx
+int editorTabsBefore(struct tabIndex *ti, int cx){
+    int lo = 0, hi = ti->count;
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if(ti->stop[mid].cx < cx) lo = mid + 1;
+        else hi = mid;
     }
-    
-    return cx;
+    return lo;
+}
+
+// render column of data index cx
+int editorRenderCol(erow *line, int cx){
+    struct tabIndex *ti = editorTabIndex(line);
+    int k = editorTabsBefore(ti, cx);
+    if(k == 0) return cx;
+
+    struct tabStop *t = &ti->stop[k - 1];
+    return t->rx + (cx - t->cx - 1);
+}
+
+int editorCxToRx(erow *line, int cx){
+    return editorRenderCol(line, cx)+GetLineNoBarWidth();
+}
+
+// frees the row's data, unless it is mapped or a running save still reads it
+void editorRowFreeData(erow *row){
+    if(row->flags & ROW_MAPPED) return;
+    if(!(row->flags & ROW_SHARED)){
+        free(row->data);
+        return;
+    }
+
+    struct saveJob *job = &Ed.save;
+    if(job->numDeferred == job->capDeferred){
+        job->capDeferred = job->capDeferred ? job->capDeferred * 2 : 64;
+        job->deferred = realloc(job->deferred, sizeof(char *) * job->capDeferred);
+        if(job->deferred == NULL) die("realloc");
+    }
+    job->deferred[job->numDeferred++] = row->data;
+}
+
+// copies a mapped or snapshotted row's data into its own buffer before it gets modified
+void editorRowMakeWritable(erow *row){
+    if(!(row->flags & (ROW_MAPPED | ROW_SHARED))) return;
+
+    char *data = malloc(row->size + 1);
+    memcpy(data, row->data, row->size);
+    data[row->size] = '\0';
+
+    editorRowFreeData(row);
+    row->data = data;
+    row->cap = row->size + 1;
+    row->flags &= ~(ROW_MAPPED | ROW_SHARED);
 }
 
 void editorUpdateRenderData(erow *line){
@@ -389,6 +1250,7 @@ void editorUpdateRenderData(erow *line){
 
     int len = line->size + tabs * TAB_SIZE + 1;
     line->renderData = malloc(len);
+    line->rCap = len;
     int j = 0;
     
     for(int i=0;i<line->size;i++){
@@ -407,93 +1269,309 @@ void editorUpdateRenderData(erow *line){
     line->rSize = j;
 }
 
-void editorInsertRow(char *line, size_t len, int idx){
-    if(idx < 0 || idx>Ed.numRows) return;
-
+// swaps the row's text for data (malloc'd, len bytes + '\0'), the rest is rebuilt lazily
+void editorRowReplaceData(erow *row, char *data, int len){
+    editorRowFreeData(row);
+    free(row->renderData);
+    free(row->tabs);
+
+    row->data = data;
+    row->size = len;
+    row->cap = len + 1;
+    row->renderData = NULL;
+    row->rSize = 0;
+    row->rCap = 0;
+    row->tabs = NULL;
+    row->flags &= ~(ROW_MAPPED | ROW_SHARED);
+
+    Ed.dirty++;
+}
 
-    Ed.row = realloc(Ed.row, sizeof(erow) * (Ed.numRows + 1)); // allocating space for new line
-    memmove(&Ed.row[idx + 1], &Ed.row[idx], sizeof(erow)*(Ed.numRows-idx));
+// returns row with its renderData built
+erow *editorRowRender(erow *row){
+    if(row->renderData == NULL) editorUpdateRenderData(row);
+    return row;
+}
 
+// inserts a row that takes over data (malloc'd, len bytes + '\0')
+void editorInsertRowOwned(char *data, int len, int idx){
+    erow *row = editorRowBufferInsert(idx); // allocating space for new line
+    row->size = len;    
+    row->data = data;
+    row->cap = len + 1;
 
-    Ed.numRows+=1;
-    Ed.row[idx].size = len;    
-    
-    Ed.row[idx].data = malloc(len + 1);
-    memcpy(Ed.row[idx].data, line, len);
-    Ed.row[idx].data[len]='\0';
+    row->rSize = 0;
+    row->rCap = 0;
+    row->renderData = NULL;
+    row->tabs = NULL;
+    row->flags = 0;
 
-    Ed.row[idx].rSize = 0;
-    Ed.row[idx].renderData = NULL;
+    Ed.dirty++;
+}
 
-    editorUpdateRenderData(&Ed.row[idx]);
-    Ed.dirty=1;
+void editorInsertRow(char *line, size_t len, int idx){
+    if(idx < 0 || idx>Ed.numRows) return;
 
-    // updating line number 
-    for(int j=0;j<Ed.numRows;j++) Ed.row[j].lineNo=j+1;
+    char *data = malloc(len + 1);
+    memcpy(data, line, len);
+    data[len]='\0';
+    editorInsertRowOwned(data, len, idx);
 }
 
-void editorInsertCharToRow(erow *line, int idx, int c){
-    int curLen = line->size;
-    if(idx < 0 || idx > curLen) idx = curLen;
+// grows a buffer geometrically so that it holds at least need bytes
+void editorReserve(char **buf, int *cap, int need){
+    if(need <= *cap) return;
 
-    line->data = realloc(line->data, curLen + 2);
-    memmove(&line->data[idx+1], &line->data[idx], curLen-idx + 1);
-    
-    line->data[idx] = c;
-    line->size++;
-    editorUpdateRenderData(line); 
-    Ed.dirty=1;
+    int newCap = *cap ? *cap : 16;
+    while(newCap < need) newCap *= 2;
+
+    char *temp = realloc(*buf, newCap);
+    if(temp == NULL) die("realloc");
+    *buf = temp;
+    *cap = newCap;
 }
 
-void editorAppendStringToRow(erow *row, char *s, size_t len) {
-    row->data = realloc(row->data, row->size + len + 1);
+/*
+    Replaces del bytes at index at of the row with ins bytes of s, and
+    patches renderData and the tab index around the edit instead of
+    rebuilding them.
+
+    Rendering only depends on the column a char lands on, and that only
+    matters for tabs. Since a tab always ends on a tab stop, everything
+    after the first tab that follows the edit renders exactly the same
+    as before, just shifted. So the render prefix before the edit is kept,
+    the edited part and the plain run up to that tab is rendered again,
+    and the rest is moved over in one memmove.
+*/
+void editorRowSplice(erow *row, int at, int del, const char *s, int ins){
+    editorRowMakeWritable(row);
+
+    int oldEnd = at + del;
+    struct tabIndex *ti = editorTabIndex(row);
+    int k0 = editorTabsBefore(ti, at), k1 = editorTabsBefore(ti, oldEnd);
+    int tab = k1 < ti->count; // a tab follows the edit
+    int run = (tab ? ti->stop[k1].cx : row->size) - oldEnd; // plain chars up to it
+
+    // render column where the edit starts, and where the untouched tail starts
+    int r0 = editorRenderCol(row, at);
+    int rTail = tab ? ti->stop[k1].rx : editorRenderCol(row, oldEnd) + run;
+
+    // data
+    int newSize = row->size - del + ins;
+    editorReserve(&row->data, &row->cap, newSize + 1);
+    memmove(&row->data[at + ins], &row->data[oldEnd], row->size - oldEnd + 1); // with '\0'
+    if(ins) memcpy(&row->data[at], s, ins);
+    row->size = newSize;
+    Ed.dirty++;
+
+    // tab index: drop deleted tabs, add inserted ones, shift the rest
+    int newTabs = 0;
+    for(int i=0;i<ins;i++) if(s[i]=='\t') newTabs++;
+
+    int count = ti->count - (k1 - k0) + newTabs;
+    editorTabIndexReserve(row, count);
+    ti = row->tabs;
+    memmove(&ti->stop[k0 + newTabs], &ti->stop[k1], sizeof(struct tabStop) * (ti->count - k1));
+    ti->count = count;
+
+    int rNew = r0, k = k0;
+    for(int i=0;i<ins;i++){
+        if(s[i]=='\t'){
+            rNew = NEXT_TAB_STOP(rNew);
+            ti->stop[k].cx = at + i;
+            ti->stop[k].rx = rNew;
+            k++;
+        }else{
+            rNew++;
+        }
+    }
+    int rRun = rNew;
+    rNew += run;
+    if(tab) rNew = NEXT_TAB_STOP(rNew);
 
-    memcpy(&row->data[row->size], s, len);
-    
-    row->size += len;
-    row->data[row->size] = '\0';
-    editorUpdateRenderData(row);
+    for(;k<count;k++){
+        ti->stop[k].cx += ins - del;
+        ti->stop[k].rx += rNew - rTail;
+    }
 
-    Ed.dirty=1;
+    if(row->renderData == NULL) return; // will be rendered when drawn
+
+    int newRSize = rNew + row->rSize - rTail;
+    editorReserve(&row->renderData, &row->rCap, newRSize + 1);
+    memmove(&row->renderData[rNew], &row->renderData[rTail], row->rSize - rTail + 1); // with '\0'
+
+    char *r = row->renderData;
+    int j = r0;
+    for(int i=0;i<ins;i++){
+        if(s[i]=='\t'){
+            int stop = NEXT_TAB_STOP(j);
+            while(j < stop) r[j++] = ' ';
+        }else{
+            r[j++] = s[i];
+        }
+    }
+    memcpy(&r[rRun], &row->data[at + ins], run);
+    for(j=rRun+run;j<rNew;j++) r[j] = ' '; // the tab
+
+    row->rSize = newRSize;
 }
 
+// deletes count rows starting at idx
+void editorDeleteRows(int idx, int count){
+    if(idx < 0 || count <= 0 || idx + count > Ed.numRows) return;
 
-void editorDeleteCharFromRow(erow* line,int idx){
-    int curLen = line->size;
-    if(idx < 0 || idx > curLen) return;
-    memmove(&line->data[idx],&line->data[idx+1],line->size-idx);
-    line->size--;
-    Ed.dirty=1;
+    for(int i=idx;i<idx+count;i++){
+        erow *row = editorRowAt(i);
+        editorRowFreeData(row);
+        free(row->renderData);
+        free(row->tabs);
+    }
 
-    editorUpdateRenderData(line);
+    // close the rows up inside the row buffer, all at once.
+    editorRowBufferDelete(idx, count);
+    Ed.dirty++;
 }
 
+/*
+    Deletes the text from (sy,sx) up to, not including, (ey,ex). Row sy
+    keeps its part before sx and gets the part of row ey from ex on
+    spliced in, the rows in between are then dropped in one go.
+*/
+void editorDeleteRange(int sy, int sx, int ey, int ex){
+    editorSearchPause();
+    editorUndoRecordDelete(sy, sx, ey, ex);
+    editorSwapRecordDelete(sy, sx, ey, ex);
+    erow *first = editorRowAt(sy);
+
+    if(sy == ey){
+        editorRowSplice(first, sx, ex - sx, NULL, 0);
+        editorSearchEdit(sy, 0, 0);
+        return;
+    }
 
-void editorDeleteRow(int idx){
-    if(idx < 0 || idx >= Ed.numRows) return;
-    
-    free(Ed.row[idx].data);
+    erow *last = editorRowAt(ey);
+    editorRowSplice(first, sx, first->size - sx, &last->data[ex], last->size - ex);
+    editorDeleteRows(sy + 1, ey - sy);
+    editorSearchEdit(sy, ey - sy, 0);
+}
 
-    // shift all rows after row[idx] by one line.
-    memmove(&Ed.row[idx],&Ed.row[idx+1], sizeof(erow)*(Ed.numRows-idx-1));
-    
+/*
+    streams the text from (y,x) up to (endY,endX) without copying it:
+    each call hands out the next span of row data, line breaks come as
+    a "\n" span of their own. spans are valid until the next edit.
+*/
+struct textIter {
+    int y, x;
+    int endY, endX;
+    int atBreak; // row y is done, its line break comes next
+};
 
-    Ed.numRows--;
-    Ed.dirty=1;
+void editorTextIterInit(struct textIter *it, int y, int x, int endY, int endX){
+    it->y = y;
+    it->x = x;
+    it->endY = endY;
+    it->endX = endX;
+    it->atBreak = 0;
+}
 
-    // updating line number 
-    for(int j=0;j<Ed.numRows;j++) Ed.row[j].lineNo=j+1;
+// returns 0 when the range is exhausted
+int editorTextIterNext(struct textIter *it, const char **s, int *len){
+    if(it->y > it->endY || (it->y == it->endY && !it->atBreak && it->x >= it->endX)) return 0;
+
+    if(it->atBreak){
+        if(it->y == it->endY) return 0;
+        it->atBreak = 0;
+        it->y++;
+        it->x = 0;
+        *s = "\n";
+        *len = 1;
+        return 1;
+    }
 
-    editorUpdateRenderData(&Ed.row[idx]);
+    erow *row = editorRowAt(it->y);
+    int end = it->y == it->endY ? it->endX : row->size;
+    *s = &row->data[it->x];
+    *len = end - it->x;
+    it->x = end;
+    it->atBreak = 1;
+    return 1;
 }
 
 /* ----- editing operations ----- */
 
-void editorInsertChar(int c){
-    if(Ed.cy==Ed.numRows){ // appending new empty line
-        editorInsertRow("", 0, Ed.numRows);
+/*
+    Inserts a multi-line buffer at (y,x) in one pass. Lines are split with
+    memchr on '\n' (a '\r' before it is dropped). The first line is
+    spliced into row y, the row buffer is grown once for all new rows,
+    and the last line gets the rest of row y appended. Each touched row is
+    written once, new rows are rendered when drawn.
+    the position right after the inserted text is stored in endY, endX.
+*/
+void editorInsertText(int y, int x, const char *s, int len, int *endY, int *endX){
+    editorSearchPause();
+    if(y==Ed.numRows){
+        // past the last row, open it up the way Enter does so the journal
+        // has it and undo takes it away again
+        int ly, lx;
+        if(Ed.numRows) editorInsertText(y - 1, editorRowAt(y - 1)->size, "\n", 1, &ly, &lx);
+        else editorInsertRow("", 0, Ed.numRows);
+    }
+
+    const char *end = s + len;
+    const char *nl = memchr(s, '\n', len);
+    erow *row = editorRowAt(y);
+
+    if(nl == NULL){ // single line, plain splice
+        editorRowSplice(row, x, 0, s, len);
+        *endY = y;
+        *endX = x + len;
+        editorSearchEdit(y, 0, 0);
+        editorUndoRecordInsert(y, x, s, len, *endY, *endX);
+        editorSwapRecordInsert(y, x, s, len);
+        return;
+    }
+
+    int lines = 0;
+    for(const char *p = nl; p; p = memchr(p + 1, '\n', end - p - 1)) lines++;
+    editorRowBufferReserve(lines);
+    row = editorRowAt(y); // reserving may have moved the rows
+
+    // the part of row y after x moves to the end of the last new row
+    int tailLen = row->size - x;
+    char *tail = malloc(tailLen + 1);
+    memcpy(tail, &row->data[x], tailLen);
+
+    int segLen = nl - s;
+    if(segLen && s[segLen - 1]=='\r') segLen--;
+    editorRowSplice(row, x, tailLen, s, segLen);
+
+    const char *p = nl + 1;
+    for(int i=1;i<=lines;i++){
+        nl = i < lines ? memchr(p, '\n', end - p) : end;
+        segLen = nl - p;
+        if(i < lines && segLen && p[segLen - 1]=='\r') segLen--;
+
+        int rowLen = segLen + (i == lines ? tailLen : 0);
+        char *data = malloc(rowLen + 1);
+        memcpy(data, p, segLen);
+        if(i == lines) memcpy(&data[segLen], tail, tailLen);
+        data[rowLen] = '\0';
+        editorInsertRowOwned(data, rowLen, y + i);
+
+        *endY = y + i;
+        *endX = segLen;
+        p = nl + 1;
     }
-    editorInsertCharToRow(&Ed.row[Ed.cy], Ed.cx, c);
+    free(tail);
+    editorSearchEdit(y, 0, *endY - y);
+    editorUndoRecordInsert(y, x, s, len, *endY, *endX);
+    editorSwapRecordInsert(y, x, s, len);
+}
+
+void editorInsertChar(int c){
+    int y, x;
+    char ch = c;
+    editorInsertText(Ed.cy, Ed.cx, &ch, 1, &y, &x);
     Ed.cx++;
 }
 
@@ -502,42 +1580,235 @@ void editorDeleteChar(){
     if(Ed.cx==0 && Ed.cy==0) return;
 
     if(Ed.cx>0){ // erase char just before cursor
-        editorDeleteCharFromRow(&Ed.row[Ed.cy], Ed.cx - 1);
+        editorDeleteRange(Ed.cy, Ed.cx - 1, Ed.cy, Ed.cx);
         Ed.cx--;
-    }else{ // moving cursor to prev line's end and performing required action.
-        Ed.cx = Ed.row[Ed.cy - 1].size;
-        editorAppendStringToRow(&Ed.row[Ed.cy-1],Ed.row[Ed.cy].data,Ed.row[Ed.cy].size);
-        editorDeleteRow(Ed.cy);
+    }else{ // moving cursor to prev line's end and joining the lines.
+        int prevLen = editorRowAt(Ed.cy - 1)->size;
+        editorDeleteRange(Ed.cy - 1, prevLen, Ed.cy, 0);
+        Ed.cx = prevLen;
         Ed.cy--;
     }
 }
 
 void editorInsertNewLine(){
-    if (Ed.cx == 0) { // pressing enter at line start
-        editorInsertRow("", 0, Ed.cy);
+    int y, x;
 
-        if(Ed.numRows==1){ // means its new file with this empty line only
-            return;
-        }
-    } else {
-        erow *row = &Ed.row[Ed.cy];
+    if (Ed.numRows == 0) { // means its new file, add its first empty line
+        editorInsertRow("", 0, 0);
+        editorSwapRecordInsert(0, 0, "", 0);
+        return;
+    }
 
+    if (Ed.cy == Ed.numRows) { // on the line after the last, open it up
+        editorInsertText(Ed.cy - 1, editorRowAt(Ed.cy - 1)->size, "\n", 1, &y, &x);
+    } else {
         // split cur row and push right string to next row
-        editorInsertRow(&row->data[Ed.cx], row->size - Ed.cx, Ed.cy + 1);
-
-        row = &Ed.row[Ed.cy];
-        row->size = Ed.cx;
-        row->data[row->size] = '\0';
-        editorUpdateRenderData(row);
+        editorInsertText(Ed.cy, Ed.cx, "\n", 1, &y, &x);
     }
 
     Ed.cy++;
     Ed.cx = 0;
 }
 
+/* ----- undo ----- */
+
+void editorUndoReserve(int ops, size_t text){
+    struct undoLog *u = &Ed.undo;
+
+    if(u->numOps + ops > u->capOps){
+        u->capOps = u->capOps ? u->capOps * 2 : 256;
+        while(u->capOps < u->numOps + ops) u->capOps *= 2;
+        u->ops = realloc(u->ops, sizeof(struct undoOp) * u->capOps);
+        if(u->ops == NULL) die("realloc");
+    }
+    if(u->arenaLen + text > u->arenaCap){
+        u->arenaCap = u->arenaCap ? u->arenaCap * 2 : 4096;
+        while(u->arenaCap < u->arenaLen + text) u->arenaCap *= 2;
+        u->arena = realloc(u->arena, u->arenaCap);
+        if(u->arena == NULL) die("realloc");
+    }
+}
+
+// memory the journal holds: the text plus the ops describing it
+size_t editorUndoSize(int numOps, size_t textLen){
+    return textLen + (size_t)numOps * sizeof(struct undoOp);
+}
+
+/*
+    forgets the oldest groups when an op with need bytes of text would not
+    fit under UNDO_LIMIT. it trims down to UNDO_TRIM_TO in one go, so the
+    memmoves below run once per quarter of the limit, not on every edit.
+    the group the current key is still recording is never cut into, if it
+    alone does not fit the whole history goes and 0 is returned.
+*/
+int editorUndoTrim(size_t need){
+    struct undoLog *u = &Ed.undo;
+    need += sizeof(struct undoOp);
+    if(editorUndoSize(u->numOps, u->arenaLen) + need <= UNDO_LIMIT) return 1;
+
+    int live = u->numOps && u->keySeq == Ed.keySeq ? u->ops[u->numOps - 1].group : -1;
+    int drop = 0;
+    size_t cut = 0;
+    while(drop < u->numOps && u->ops[drop].group != live && editorUndoSize(u->numOps - drop, u->arenaLen - cut) + need > UNDO_TRIM_TO){
+        // whole groups only
+        int g = u->ops[drop].group;
+        while(drop < u->numOps && u->ops[drop].group == g) drop++;
+        cut = drop < u->numOps ? u->ops[drop].text : u->arenaLen;
+    }
+
+    if(editorUndoSize(u->numOps - drop, u->arenaLen - cut) + need > UNDO_LIMIT){
+        u->numOps = u->applied = 0;
+        u->arenaLen = 0;
+        return 0;
+    }
+
+    memmove(u->arena, &u->arena[cut], u->arenaLen - cut);
+    u->arenaLen -= cut;
+
+    memmove(u->ops, &u->ops[drop], sizeof(struct undoOp) * (u->numOps - drop));
+    u->numOps -= drop;
+    u->applied -= drop;
+    for(int i=0;i<u->numOps;i++) u->ops[i].text -= cut;
+    return 1;
+}
+
+/*
+    starts a new op, or returns the last one if this edit continues it.
+    anything that was undone is dropped, it cant be redone after an edit.
+*/
+struct undoOp *editorUndoPush(int type, int y, int x, int endY, int endX, size_t len){
+    struct undoLog *u = &Ed.undo;
+    if(u->lostSeq == Ed.keySeq) return NULL; // part of a group already dropped
+
+    u->numOps = u->applied;
+    u->arenaLen = u->numOps ? u->ops[u->numOps - 1].text + u->ops[u->numOps - 1].len : 0;
+
+    // cant ever be undone, dont keep a partial history
+    if(editorUndoSize(1, len) > UNDO_LIMIT || !editorUndoTrim(len)){
+        u->numOps = u->applied = 0;
+        u->arenaLen = 0;
+        u->lostSeq = Ed.keySeq;
+        return NULL;
+    }
+    editorUndoReserve(1, len);
+
+    // edits made by one key are one group. the next key continuing the
+    // run coalesces: typing appends to the op, backspace joins the group
+    struct undoOp *last = u->numOps ? &u->ops[u->numOps - 1] : NULL;
+    int sameKey = last && u->keySeq == Ed.keySeq;
+    int sameRun = last && u->keySeq == Ed.keySeq - 1 && last->type == type && len == 1;
+    if(sameRun && type == UNDO_INSERT && last->y == y && last->endY == y && last->endX == x && endY == y){
+        last->endX = endX;
+        u->keySeq = Ed.keySeq;
+        return last;
+    }
+    if(!sameKey && !(sameRun && type == UNDO_DELETE && last->y == y && last->x == x + 1 && endY == y)){
+        u->group++;
+    }
+
+    struct undoOp *op = &u->ops[u->numOps++];
+    op->type = type;
+    op->group = u->group;
+    op->y = y; op->x = x;
+    op->endY = endY; op->endX = endX;
+    op->text = u->arenaLen;
+    op->len = 0;
+    op->cy = Ed.cy; op->cx = Ed.cx;
+
+    u->applied = u->numOps;
+    u->keySeq = Ed.keySeq;
+    return op;
+}
+
+void editorUndoRecordInsert(int y, int x, const char *s, int len, int endY, int endX){
+    if(Ed.undo.replaying) return;
+
+    struct undoOp *op = editorUndoPush(UNDO_INSERT, y, x, endY, endX, len);
+    if(op == NULL) return;
+
+    memcpy(&Ed.undo.arena[op->text + op->len], s, len);
+    op->len += len;
+    Ed.undo.arenaLen = op->text + op->len;
+}
+
+// keeps a copy of the text in (sy,sx)-(ey,ex) before it gets deleted
+void editorUndoRecordDelete(int sy, int sx, int ey, int ex){
+    if(Ed.undo.replaying) return;
+
+    struct textIter it;
+    const char *span;
+    int spanLen;
+    size_t len = 0;
+
+    editorTextIterInit(&it, sy, sx, ey, ex);
+    while(editorTextIterNext(&it, &span, &spanLen)) len += spanLen;
+
+    struct undoOp *op = editorUndoPush(UNDO_DELETE, sy, sx, ey, ex, len);
+    if(op == NULL) return;
+
+    editorTextIterInit(&it, sy, sx, ey, ex);
+    while(editorTextIterNext(&it, &span, &spanLen)){
+        memcpy(&Ed.undo.arena[op->text + op->len], span, spanLen);
+        op->len += spanLen;
+    }
+    Ed.undo.arenaLen = op->text + op->len;
+}
+
+// applies op forwards (redo) or backwards (undo)
+void editorUndoApply(struct undoOp *op, int forward){
+    int y, x;
+    int insert = (op->type == UNDO_INSERT) == forward;
+
+    Ed.undo.replaying = 1;
+    if(insert){
+        editorInsertText(op->y, op->x, &Ed.undo.arena[op->text], op->len, &y, &x);
+    }else{
+        editorDeleteRange(op->y, op->x, op->endY, op->endX);
+    }
+    Ed.undo.replaying = 0;
+}
+
+void editorUndo(){
+    struct undoLog *u = &Ed.undo;
+    if(u->applied == 0){
+        editorSetStatusMessage("Nothing to undo");
+        return;
+    }
+
+    int g = u->ops[u->applied - 1].group;
+    while(u->applied > 0 && u->ops[u->applied - 1].group == g){
+        struct undoOp *op = &u->ops[--u->applied];
+        editorUndoApply(op, 0);
+        Ed.cy = op->cy;
+        Ed.cx = op->cx;
+    }
+    u->keySeq = -1; // dont let the next keystroke join the undone op
+}
+
+void editorRedo(){
+    struct undoLog *u = &Ed.undo;
+    if(u->applied == u->numOps){
+        editorSetStatusMessage("Nothing to redo");
+        return;
+    }
+
+    int g = u->ops[u->applied].group;
+    while(u->applied < u->numOps && u->ops[u->applied].group == g){
+        struct undoOp *op = &u->ops[u->applied++];
+        editorUndoApply(op, 1);
+        Ed.cy = op->type == UNDO_INSERT ? op->endY : op->y;
+        Ed.cx = op->type == UNDO_INSERT ? op->endX : op->x;
+    }
+    u->keySeq = -1;
+}
+
 /* ----- output processing ----- */
 
-void editorPaintSelectedData(struct ab_buf* b,int i,int realY, erow* line){
+/*
+    finds which render columns of row realY are selected, both ends inclusive.
+    returns 0 if nothing on that row is selected.
+*/
+int editorSelectedColumns(erow* line, int realY, int *from, int *to){
 
     int stX = Ed.sx, stY = Ed.sy, enX = Ed.ex, enY = Ed.ey;
 
@@ -557,54 +1828,87 @@ void editorPaintSelectedData(struct ab_buf* b,int i,int realY, erow* line){
         }
     }
 
+    if(realY < stY || realY > enY) return 0;
 
     // render cursor positions
-    int stX_r = editorCxToRx (line, stX)-GetLineNoBarWidth();
-    int enX_r = editorCxToRx(line, enX)-GetLineNoBarWidth();
-    int rx = i;
-
-
-    if(realY==stY){ 
-        if((stY==enY && rx >= stX_r && rx <= enX_r) || (stY<enY && rx >= stX_r)){
-            // editorSetStatusMessage("%d,%d=>%d,%d | %d",stX,enX,stX_r,enX_r,rx);
-            // editorSetStatusMessage("%s", line->renderData);
-
-            // paint
-            ab_append(b, "\x1b[48;5;15m", 10); // bg
-            ab_append(b, "\x1b[38;5;16m", 10); // text
-        }
-    }else if(realY==enY){
-        if(rx <= enX_r){
-            // paint
-            ab_append(b, "\x1b[48;5;15m", 10); // bg
-            ab_append(b, "\x1b[38;5;16m", 10); // text
-        }
-    }else if(realY<=enY && realY>=stY){
-        // paint
-        ab_append(b, "\x1b[48;5;15m", 10); // bg
-        ab_append(b, "\x1b[38;5;16m", 10); // text
-    }
+    *from = realY==stY ? editorCxToRx(line, stX)-GetLineNoBarWidth() : 0;
+    *to = realY==enY ? editorCxToRx(line, enX)-GetLineNoBarWidth() : line->rSize;
+    return 1;
 }
 
 void editorPasteData(){ 
     if (Ed.copied) { 
-        int j = 0; 
+        // whole buffer goes in at once, cursor ends up after it. the end
+        // is set only after the call, the undo op keeps the cursor before
+        int y, x;
+        editorInsertText(Ed.cy, Ed.cx, Ed.copiedData, Ed.copiedDataLen, &y, &x);
+        Ed.cy = y;
+        Ed.cx = x;
+    }
+}
 
-        while (Ed.copiedData[j] != '\0') {
-            char currentChar = Ed.copiedData[j];
+/*
+    reads a bracketed paste into text, up to PASTE_END, straight from the
+    input buffer in whole reads. line breaks come in as '\r' (or "\r\n")
+    and are turned into '\n'.
+*/
+void editorReadPaste(struct ab_buf *text){
+    struct inputBuffer *in = &Ed.in;
+    int endLen = sizeof(PASTE_END) - 1;
+    int scanned = 0;
+    long long deadline = editorNowMs() + PASTE_TIMEOUT_MS;
+
+    ab_grow(text, INPUT_BUF_SIZE);
+    while(1){
+        ab_append(text, in->buf + in->start, in->len);
+        in->start = 0;
+        in->len = 0;
+
+        // the end marker may be split over two reads
+        char *p = text->buf + scanned, *end = text->buf + text->len;
+        while((p = memchr(p, '\x1b', end - p)) != NULL && end - p >= endLen){
+            if(memcmp(p, PASTE_END, endLen) == 0) break;
+            p++;
+        }
+        if(p && end - p >= endLen){
+            // keys typed right after the paste go back to the input
+            in->len = end - (p + endLen);
+            memcpy(in->buf, p + endLen, in->len);
+            text->len = p - text->buf;
+            break;
+        }
+        scanned = p ? p - text->buf : text->len;
 
-            if (currentChar == '\r' && Ed.copiedData[j + 1] == '\n') {
-                editorInsertNewLine();
-                j += 2;
-                continue;
-            }
+        long long now = editorNowMs();
+        if(now >= deadline) break; // the end marker got lost
+        if(editorReadInput(deadline - now) > 0) deadline = editorNowMs() + PASTE_TIMEOUT_MS;
+    }
 
-            // insert char at Ed.cx
-            editorInsertCharToRow(&Ed.row[Ed.cy], Ed.cx, currentChar);
-            Ed.cx++;  
-            j++;
+    int w = 0;
+    for(int r = 0; r < text->len; r++){
+        if(text->buf[r] == '\r'){
+            text->buf[w++] = '\n';
+            if(r + 1 < text->len && text->buf[r + 1] == '\n') r++;
+        }else{
+            text->buf[w++] = text->buf[r];
         }
     }
+    text->len = w;
+}
+
+// pasted from the terminal, inserted at the cursor in one edit
+void editorPasteInput(){
+    struct ab_buf text = ab_BUF_INIT;
+
+    editorReadPaste(&text);
+    TRACE("paste", text.len, 0);
+    if(text.len){
+        int y, x;
+        editorInsertText(Ed.cy, Ed.cx, text.buf, text.len, &y, &x);
+        Ed.cy = y;
+        Ed.cx = x;
+    }
+    ab_free(&text);
 }
 
 void editorSetStatusMessage(char *s, ...){ // variadic func.
@@ -626,7 +1930,14 @@ void editorSetStatusMessage(char *s, ...){ // variadic func.
 }
 
 void editorDrawStatusMessage(struct ab_buf *b){
-    ab_append(b, "\x1b[K", 3);
+    ab_appendLit(b, "\x1b[m\x1b[K");
+
+    char prof[256];
+    int plen = profFormat(prof, sizeof(prof));
+    if (plen) { // profiler overlay takes the message bar while it is on
+        ab_append(b, prof, plen > Ed.screenCols ? Ed.screenCols : plen);
+        return;
+    }
     
     int len = strlen(Ed.statusmsg);
 
@@ -638,346 +1949,2482 @@ void editorDrawStatusMessage(struct ab_buf *b){
 }
 
 void editorDrawStatusBar(struct ab_buf *b){
-    ab_append(b, "\x1b[7m", 4); // negative image (here white bg)
+    ab_appendLit(b, "\x1b[7m"); // negative image (here white bg)
+
+    // printing file name
+    char status[80], curStatus[80];
+    int len;
+    if(Ed.index.active){ // line count so far, file is still being indexed
+        long lines = Ed.index.baseRows + atomic_load(&Ed.index.linesFound);
+        len = snprintf(status, sizeof(status), "%.20s - %ld+ lines (indexing) %s", Ed.filename, lines, Ed.dirty ? "(modified)" : "");
+    }else if(Ed.save.active){
+        long long total = Ed.save.total ? Ed.save.total : 1;
+        int pct = atomic_load(&Ed.save.written) * 100 / total;
+        len = snprintf(status, sizeof(status), "%.20s - %d lines (saving %d%%) %s", Ed.filename, Ed.numRows, pct, Ed.dirty ? "(modified)" : "");
+    }else{
+        len = snprintf(status, sizeof(status), "%.20s - %d lines %s", Ed.filename, Ed.numRows, Ed.dirty ? "(modified)" : "");
+    }
+    int rlen;
+    struct searchState *st = &Ed.search;
+    if(st->query){ // match k of N, k only when the cursor is on a match
+        int k = editorSearchLowerBound(Ed.cy, Ed.cx);
+        int on = k < st->numMatches && st->matches[k].y == Ed.cy && st->matches[k].x == Ed.cx;
+        char *more = editorSearchComplete() ? "" : "+";
+        if(on) rlen = snprintf(curStatus, sizeof(curStatus), "match %d of %d%s | %d/%d", k + 1, st->numMatches, more, Ed.cy+1, Ed.numRows);
+        else rlen = snprintf(curStatus, sizeof(curStatus), "%d%s matches | %d/%d", st->numMatches, more, Ed.cy+1, Ed.numRows);
+    }else{
+        rlen = snprintf(curStatus, sizeof(curStatus), "%d/%d", Ed.cy+1, Ed.numRows);
+    }
+
+    ab_append(b, status, len);
+
+    while (len < Ed.screenCols + GetLineNoBarWidth()) {
+        if (Ed.screenCols + GetLineNoBarWidth() - len == rlen) {
+            ab_append(b, curStatus, rlen);
+            break;
+        } else {
+            ab_appendc(b, ' ');
+            len++;
+        }
+    }
+    ab_appendLit(b, "\x1b[m");
+}
+
+void editorDrawLineNos(struct ab_buf *b, int id){
+    ab_appendLit(b, "\x1b[1m"); // bold
+    ab_appendLit(b, "\x1b[48;5;15m"); // bg
+    ab_appendLit(b, "\x1b[38;5;16m"); // text
+    // ab_append(b, "\x1b[4m",  4); // underline
+
+    // an int has at most 10 digits, the bound lets the compiler see
+    // the number always fits
+    char s[12];
+    int width = GetLineNoBarWidth();
+    if(width > 10) width = 10;
+    // line numbers are not stored, row index is the line number.
+    snprintf(s, sizeof(s), "%*u", width, (unsigned)id + 1);
+    ab_append(b, s, width);
+    
+    ab_appendLit(b, "\x1b[m");
+}
+
+// '~' in place of a line number, padded to the line no bar width
+void editorDrawTildeBar(struct ab_buf *b){
+    ab_appendc(b, '~');
+    for(int i=1;i<GetLineNoBarWidth();i++) ab_appendc(b, ' ');
+}
+
+/*
+    text area cell styles. the row renderer tracks the style it last
+    emitted and only writes SGR codes when the next cell differs, so a
+    run of same styled chars costs a single memcpy.
+*/
+#define HL_NORMAL 0
+#define HL_DIGIT 1
+#define HL_SELECTED 2
+#define HL_MATCH 4
+
+void editorSetTextStyle(struct ab_buf *b, int from, int to){
+    // selection wins over a search match
+    int fromBg = from & HL_SELECTED ? 15 : from & HL_MATCH ? 178 : 53;
+    int toBg = to & HL_SELECTED ? 15 : to & HL_MATCH ? 178 : 53;
+    if(fromBg != toBg){
+        if(toBg == 15) ab_appendLit(b, "\x1b[48;5;15m"); // bg
+        else if(toBg == 178) ab_appendLit(b, "\x1b[48;5;178m"); // gold bg
+        else ab_appendLit(b, "\x1b[48;5;53m"); // bluish bg
+    }
+
+    // fg depends on all bits, highlighted text is black, digits stay green
+    int fromFg = from & HL_DIGIT ? 46 : from & (HL_SELECTED | HL_MATCH) ? 16 : 15;
+    int toFg = to & HL_DIGIT ? 46 : to & (HL_SELECTED | HL_MATCH) ? 16 : 15;
+    if(fromFg != toFg){
+        if(toFg == 46) ab_appendLit(b, "\x1b[38;5;46m");
+        else if(toFg == 16) ab_appendLit(b, "\x1b[38;5;16m");
+        else ab_appendLit(b, "\x1b[38;5;15m");
+    }
+}
+
+// draws screen line y of the text area (without moving to the next line)
+void editorDrawRow(struct ab_buf *b, int y) {
+    int realY = y + Ed.scrollYOffset;
+
+    if(realY >= Ed.numRows){
+        
+        // set colors for line no side bar.
+        ab_appendLit(b, "\x1b[1m"); // bold
+        ab_appendLit(b, "\x1b[48;5;15m"); // bg
+        ab_appendLit(b, "\x1b[38;5;16m"); // text
+
+        // we only show wlcm msg when user open empty editor
+        if (y == Ed.screenRows / 2 && !Ed.START) {
+
+            char welcome[80];
+            int welcomelen = snprintf(welcome, sizeof(welcome), "TEXTER -- version %s", TEXTER_VERSION);
+            if (welcomelen > Ed.screenCols) welcomelen = Ed.screenCols;
+
+            
+            int padding = (Ed.screenCols - welcomelen) / 2;
+            if (padding) {
+                editorDrawTildeBar(b);
+                padding--;
+            }
+
+            ab_appendLit(b, "\x1b[m"); // reset color setting
+            while (padding--) ab_appendc(b, ' ');
+
+            
+            ab_append(b, welcome, welcomelen);
+        } else { // printing tildes
+            editorDrawTildeBar(b);
+        }
+
+        ab_appendLit(b, "\x1b[m");
+
+        
+    }else{
+        editorDrawLineNos(b, realY);
+
+        // setting screen bg color to bluish
+        ab_appendLit(b, "\x1b[48;5;53m");
+        ab_appendLit(b, "\x1b[38;5;15m"); // text
+
+        erow *row = editorRowRender(editorRowAt(realY));
+        int len = row->rSize - Ed.scrollXOffset;
+
+        // truncate data lines to screenCols
+        if(len < 0) len = 0;
+        if (len > Ed.screenCols) len = Ed.screenCols;
+
+        char *c = &row->renderData[Ed.scrollXOffset];
+
+        // selected render columns of this row, relative to the screen
+        int selFrom = 0, selTo = -1;
+        if(Ed.selected && editorSelectedColumns(row, realY, &selFrom, &selTo)){
+            selFrom -= Ed.scrollXOffset;
+            selTo -= Ed.scrollXOffset;
+        }
+
+        // search matches of this row come from the index, walked left to
+        // right. mFrom..mTo are the screen columns of the match at m.
+        struct searchState *st = &Ed.search;
+        int m = st->query ? editorSearchLowerBound(realY, 0) : st->numMatches;
+        int mFrom = len, mTo = -1;
+
+        // emit runs of equally styled chars, styles change only at run ends
+        int style = HL_NORMAL, runStart = 0;
+        for(int i=0;i<len;i++){
+            int hl = isdigit(c[i]) ? HL_DIGIT : HL_NORMAL;
+            if(i >= selFrom && i <= selTo) hl |= HL_SELECTED;
+
+            while(i > mTo && m < st->numMatches && st->matches[m].y == realY){
+                mFrom = editorRenderCol(row, st->matches[m].x) - Ed.scrollXOffset;
+                mTo = editorRenderCol(row, st->matches[m].x + st->matches[m].len) - 1 - Ed.scrollXOffset;
+                m++;
+            }
+            if(i >= mFrom && i <= mTo) hl |= HL_MATCH;
+
+            if(hl != style){
+                ab_append(b, &c[runStart], i - runStart);
+                editorSetTextStyle(b, style, hl);
+                style = hl;
+                runStart = i;
+            }
+        }
+        ab_append(b, &c[runStart], len - runStart);
+
+        // rest of the line is cleared with the normal bg
+        editorSetTextStyle(b, style, HL_NORMAL);
+    }
+
+    ab_appendLit(b, "\x1b[K");
+}
+
+void editorScroll() {
+    // calculating rx using cx
+    Ed.rx = Ed.cx;
+    if(Ed.cy < Ed.numRows) Ed.rx = editorCxToRx(editorRowAt(Ed.cy), Ed.cx);
+
+    // when we try to move up, it decreases the offsetY, 
+    // so that we can view code from that desired cursor pos.
+    if (Ed.cy < Ed.scrollYOffset) {
+        Ed.scrollYOffset = Ed.cy;
+    }
+
+    // same thing for scroll down, [to view content below when scrolling down]
+    if (Ed.cy >= Ed.scrollYOffset + Ed.screenRows) {
+        Ed.scrollYOffset = Ed.cy - Ed.screenRows + 1;
+    }
+
+
+    if (Ed.rx < Ed.scrollXOffset + GetLineNoBarWidth()) {
+        Ed.scrollXOffset = Ed.rx-GetLineNoBarWidth();
+    }
+
+    // same thing for scroll down, [to view content below when scrolling down]
+    if (Ed.rx >= Ed.scrollXOffset + Ed.screenCols + GetLineNoBarWidth()) {
+        Ed.scrollXOffset = Ed.rx - Ed.screenCols + 1 - GetLineNoBarWidth();
+    }
+}
+
+/*
+    WHY?? 
+    If you try to scroll back up, you may notice the cursor isn’t being positioned properly.
+    That is because E.cy no longer refers to the position of the cursor on the screen. 
+    It refers to the position of the cursor within the text file. 
+    To position the cursor on the screen, we now have to subtract E.rowoff from the value of E.cy.
+*/
+
+// forces the next refresh to repaint the whole screen
+void editorInvalidateFrame(){
+    Ed.frameValid = 0;
+}
+
+/*
+    The terminal keeps showing the last frame, so a scroll by a few lines
+    only needs the terminal to shift what it already has (scroll region
+    of the text area + SU/SD) and the shadow lines shifted the same way.
+    The lines that scrolled in are left empty and get drawn by the diff.
+*/
+void editorScrollFrame(struct ab_buf *b){
+    int delta = Ed.scrollYOffset - Ed.frameScrollY;
+    int n = delta > 0 ? delta : -delta;
+    Ed.frameScrollY = Ed.scrollYOffset;
+
+    if(n == 0) return;
+    if(n >= Ed.screenRows){ // nothing on screen survives
+        for(int y=0;y<Ed.screenRows;y++) Ed.frame[y].len = 0;
+        return;
+    }
+
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[m\x1b[1;%dr\x1b[%d%c\x1b[r", Ed.screenRows, n, delta > 0 ? 'S' : 'T');
+    ab_append(b, buf, len);
+
+    // rotate shadow lines along with the screen, keeping their buffers
+    struct ab_buf tmp[n];
+    if(delta > 0){
+        memcpy(tmp, Ed.frame, sizeof(struct ab_buf) * n);
+        memmove(Ed.frame, &Ed.frame[n], sizeof(struct ab_buf) * (Ed.screenRows - n));
+        memcpy(&Ed.frame[Ed.screenRows - n], tmp, sizeof(struct ab_buf) * n);
+        for(int y=Ed.screenRows-n;y<Ed.screenRows;y++) Ed.frame[y].len = 0;
+    }else{
+        memcpy(tmp, &Ed.frame[Ed.screenRows - n], sizeof(struct ab_buf) * n);
+        memmove(&Ed.frame[n], Ed.frame, sizeof(struct ab_buf) * (Ed.screenRows - n));
+        memcpy(Ed.frame, tmp, sizeof(struct ab_buf) * n);
+        for(int y=0;y<n;y++) Ed.frame[y].len = 0;
+    }
+}
+
+// draws screen line y into line, and emits it only if it changed
+void editorDiffLine(struct ab_buf *b, struct ab_buf *line, int y){
+    struct ab_buf *old = &Ed.frame[y];
+    if(line->len == old->len && memcmp(line->buf, old->buf, line->len) == 0) return;
+
+    ab_appendCursor(b, y + 1, 1);
+    ab_append(b, line->buf, line->len);
+
+    // the new line becomes the shadow, old buffer is reused as scratch
+    struct ab_buf tmp = *old;
+    *old = *line;
+    *line = tmp;
+}
+
+void editorRefreshScreen(){
+    TRACE("frame.start", Ed.cy, Ed.scrollYOffset);
+    profFrameStart();
+    editorScroll();
+
+    /* 
+        Escape sequences are used to put nonprintable characters in character and string literals
+        such as backspace, tab, color, cursor locations etc.
+    */
+
+    struct ab_buf *b = &Ed.out;
+    ab_reset(b);
+    
+    ab_appendLit(b, "\x1b[?25l"); // disable pointer
+
+    if(Ed.frame == NULL){
+        Ed.frameLines = Ed.screenRows + 2;
+        Ed.frame = calloc(Ed.frameLines, sizeof(struct ab_buf));
+        if(Ed.frame == NULL) die("calloc");
+    }
+
+    if(!Ed.frameValid){ // start from a blank screen
+        // set ptr color
+        ab_appendLit(b, "\x1b]12;#b3b3b3\x1b\\");
+
+        // set cursor style 
+        // ab_append(&b, "\x1b[5 q", 5);
+
+        ab_appendLit(b, "\x1b[m\x1b[2J");
+        for(int y=0;y<Ed.frameLines;y++) Ed.frame[y].len = 0;
+        Ed.frameScrollY = Ed.scrollYOffset;
+        Ed.frameValid = 1;
+    }else{
+        editorScrollFrame(b);
+    }
+
+    // draw every line, but only send the ones that differ from the last frame
+    struct ab_buf *line = &Ed.scratch;
+    for(int y=0;y<Ed.screenRows;y++){
+        ab_reset(line);
+        editorDrawRow(line, y);
+        editorDiffLine(b, line, y);
+    }
+
+    ab_reset(line);
+    editorDrawStatusBar(line);
+    editorDiffLine(b, line, Ed.screenRows);
+
+    ab_reset(line);
+    editorDrawStatusMessage(line);
+    editorDiffLine(b, line, Ed.screenRows + 1);
+
+    // to position the cursor according to our cursor pos variables.
+    // read here about '[H': https://vt100.net/docs/vt100-ug/chapter3.html#CUP
+    ab_appendCursor(b, Ed.cy - Ed.scrollYOffset + 1, Ed.rx - Ed.scrollXOffset + 1);
+
+    ab_appendLit(b, "\x1b[?25h"); // enable pointer
+    
+    profFrameDrawn();
+    write(Ed.outFd, b->buf, b->len); //finally writing buffer to stdout
+    profFrameEnd(b->len);
+    TRACE("frame.end", b->len, 0);
+}
+
+
+/* ----- file-io ----- */
+
+// adds a row at the end of file which points into the mapped file
+void editorAppendMappedRow(char *line, int len){
+    erow *row = editorRowBufferInsert(Ed.numRows);
+    row->size = len;
+    row->cap = 0;
+    row->data = line;
+    row->rSize = 0;
+    row->rCap = 0;
+    row->renderData = NULL;
+    row->tabs = NULL;
+    row->flags = ROW_MAPPED;
+}
+
+// appends rows for up to maxRows lines (all if < 0) of [p,end),
+// returns where it stopped.
+char *editorAppendMappedRows(char *p, char *end, int maxRows){
+    while(p < end && maxRows--){
+        char *nl = memchr(p, '\n', end - p);
+        char *lineEnd = nl ? nl : end;
+
+        // strip off the carriage returns at the end
+        while(lineEnd > p && lineEnd[-1]=='\r') lineEnd--;
+
+        editorAppendMappedRow(p, lineEnd - p);
+        p = nl ? nl + 1 : end;
+    }
+    return p;
+}
+
+void *editorIndexWorker(void *arg){
+    struct lineIndex *idx = arg;
+    int k;
+
+    while((k = atomic_fetch_add(&idx->nextChunk, 1)) < idx->numChunks){
+        struct indexChunk *ch = &idx->chunks[k];
+        char *p = idx->base + ch->start, *end = idx->base + ch->end;
+
+        while((p = memchr(p, '\n', end - p)) != NULL){
+            if(ch->count == ch->cap){
+                ch->cap = ch->cap ? ch->cap * 2 : 4096;
+                ch->nl = realloc(ch->nl, sizeof(uint32_t) * ch->cap);
+                if(ch->nl == NULL) die("realloc");
+            }
+            ch->nl[ch->count++] = p - (idx->base + ch->start);
+            p++;
+        }
+
+        atomic_fetch_add(&idx->linesFound, ch->count);
+        atomic_store(&ch->done, 1);
+        TRACE("index.chunk", k, ch->count);
+        editorWake();
+    }
+    return NULL;
+}
+
+// hands [p,end) of the mapped file to the indexing threads
+void editorIndexStart(char *p, char *end){
+    struct lineIndex *idx = &Ed.index;
+
+    if(end - p <= INDEX_CHUNK_SIZE){ // not worth a thread
+        editorAppendMappedRows(p, end, -1);
+        return;
+    }
+
+    idx->base = Ed.map;
+    idx->len = Ed.mapLen;
+    idx->lineStart = p - Ed.map;
+    idx->baseRows = Ed.numRows;
+    idx->merged = 0;
+    atomic_store(&idx->nextChunk, 0);
+    atomic_store(&idx->linesFound, 0);
+
+    idx->numChunks = (end - p + INDEX_CHUNK_SIZE - 1) / INDEX_CHUNK_SIZE;
+    idx->chunks = calloc(idx->numChunks, sizeof(struct indexChunk));
+    if(idx->chunks == NULL) die("calloc");
+    for(int i=0;i<idx->numChunks;i++){
+        idx->chunks[i].start = idx->lineStart + (size_t)i * INDEX_CHUNK_SIZE;
+        idx->chunks[i].end = idx->chunks[i].start + INDEX_CHUNK_SIZE;
+        if(idx->chunks[i].end > idx->len) idx->chunks[i].end = idx->len;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    idx->numThreads = cores < 1 ? 1 : cores > 64 ? 64 : cores;
+    if(idx->numThreads > idx->numChunks) idx->numThreads = idx->numChunks;
+
+    idx->threads = malloc(sizeof(pthread_t) * idx->numThreads);
+    for(int i=0;i<idx->numThreads;i++){
+        if(pthread_create(&idx->threads[i], NULL, editorIndexWorker, idx) != 0) die("pthread_create");
+    }
+    idx->active = 1;
+}
+
+/*
+    turns finished chunks into rows, strictly in file order so rows are
+    only ever appended. returns 1 if any rows were added.
+*/
+int editorIndexMerge(){
+    struct lineIndex *idx = &Ed.index;
+    if(!idx->active) return 0;
+
+    int added = 0;
+    while(idx->merged < idx->numChunks && atomic_load(&idx->chunks[idx->merged].done)){
+        struct indexChunk *ch = &idx->chunks[idx->merged];
+
+        editorRowBufferReserve(ch->count);
+        for(int i=0;i<ch->count;i++){
+            size_t nl = ch->start + ch->nl[i];
+            char *line = idx->base + idx->lineStart, *lineEnd = idx->base + nl;
+
+            while(lineEnd > line && lineEnd[-1]=='\r') lineEnd--;
+            editorAppendMappedRow(line, lineEnd - line);
+            idx->lineStart = nl + 1;
+        }
+
+        free(ch->nl);
+        idx->merged++;
+        added = 1;
+    }
+
+    if(idx->merged == idx->numChunks){ // all done, last line may lack '\n'
+        for(int i=0;i<idx->numThreads;i++) pthread_join(idx->threads[i], NULL);
+        if(idx->lineStart < idx->len){
+            editorAppendMappedRows(idx->base + idx->lineStart, idx->base + idx->len, -1);
+        }
+
+        free(idx->threads);
+        free(idx->chunks);
+        idx->threads = NULL;
+        idx->chunks = NULL;
+        idx->active = 0;
+        added = 1;
+    }
+    return added;
+}
+
+// blocks until the whole file is indexed, for operations that need every row
+void editorIndexFinish(){
+    while(Ed.index.active){
+        if(!editorIndexMerge()){
+            struct timespec ts = {0, 1000000}; // 1ms
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+void editorOpenFile(char *filename){
+    Ed.filename = strdup(filename);
+
+    int fd = open(filename, O_RDONLY);
+    if(fd==-1)die("open");
+
+    struct stat st;
+    if(fstat(fd, &st)==-1)die("fstat");
+
+    /*
+        Instead of reading the file line by line into fresh buffers, the
+        whole file is mmap'd and rows just point into the mapping. Row data
+        is copied only when that line gets edited, and renderData is built
+        only when the line gets drawn, so opening costs one memchr pass.
+    */
+    if(st.st_size > 0){
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map==MAP_FAILED)die("mmap");
+
+        Ed.map = map;
+        Ed.mapLen = st.st_size;
+
+        // index just enough to paint the first screen here, the rest
+        // of the file is indexed in background threads.
+        char *p = editorAppendMappedRows(map, map + st.st_size, Ed.screenRows);
+        if(p < map + st.st_size) editorIndexStart(p, map + st.st_size);
+    }
+
+    close(fd);
+    Ed.dirty=0;
+
+    editorSwapRecover(filename);
+}
+
+#define SAVE_IOV 1024 // iovecs per writev, two per row (text + '\n')
+
+/*
+    writes every snapshotted row followed by '\n' to fd, in writev batches.
+    done is what earlier passes over the rows wrote, for the progress.
+*/
+int editorWriteRows(int fd, struct saveJob *job, long long done, long long *written){
+    struct iovec iov[SAVE_IOV];
+    *written = 0;
+
+    for(int i=0;i<job->numLines;){
+        int n = 0;
+        for(; i < job->numLines && n + 2 <= SAVE_IOV; i++){
+            iov[n] = job->lines[i];
+            iov[n + 1].iov_base = "\n";
+            iov[n + 1].iov_len = 1;
+            n += 2;
+        }
+
+        // writev may stop short, go on from where it stopped
+        struct iovec *v = iov;
+        while(n > 0){
+            ssize_t w = writev(fd, v, n);
+            if(w == -1){
+                if(errno == EINTR) continue;
+                return -1;
+            }
+            *written += w;
+            atomic_store_explicit(&job->written, done + *written, memory_order_relaxed);
+            while(n > 0 && (size_t)w >= v->iov_len){
+                w -= v->iov_len;
+                v++;
+                n--;
+            }
+            if(n > 0){
+                v->iov_base = (char *)v->iov_base + w;
+                v->iov_len -= w;
+            }
+        }
+    }
+    return 0;
+}
+
+// creates the temp file .<name>.XXXXXX next to filename, dir is set to its directory
+int editorSaveTemp(const char *filename, char *dir, char *tmp){
+    const char *slash = strrchr(filename, '/');
+    int dirLen = slash ? slash - filename : 0;
+
+    if(slash) snprintf(dir, PATH_MAX, "%.*s", dirLen ? dirLen : 1, filename);
+    else snprintf(dir, PATH_MAX, ".");
+    if(snprintf(tmp, PATH_MAX, "%s/.%s.XXXXXX", dir, slash ? slash + 1 : filename) >= PATH_MAX){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return mkstemp(tmp);
+}
+
+// the rename or unlink of a name in dir is only durable once dir is synced
+void editorSyncDir(const char *dir){
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if(dfd != -1){
+        fsync(dfd);
+        close(dfd);
+    }
+}
+
+/*
+    a file a rename would cut loose (see editorSaveInPlace) is written
+    over in two steps. first the rows go to a temp file next to it, which
+    is fsync'd, so a crash or a full disk halfway through the rewrite
+    still leaves the new text on disk. without a place for it nothing is
+    written. the rows are then moved onto the temp file's mapping (see
+    editorSaveFinish) and only after that editorCopyBackup copies it over
+    the file, so rows never point into a file that is being rewritten and
+    none of them has to be copied to memory.
+*/
+long long editorWriteBackup(const char *filename, struct saveJob *job){
+    char dir[PATH_MAX], tmp[PATH_MAX];
+    long long written;
+
+    int fd = editorSaveTemp(filename, dir, tmp);
+    if(fd == -1) return -1;
+    if(editorWriteRows(fd, job, 0, &written) == -1 || fsync(fd) == -1){
+        int err = errno;
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    if(close(fd) == -1){
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    editorSyncDir(dir);
+
+    job->backup = strdup(tmp);
+    if(job->backup == NULL) die("strdup");
+    return written;
+}
+
+#define SAVE_COPY_BUF (1 << 20)
+
+/*
+    second step of an in place save: writes the backup over the file, not
+    truncating it up front but cutting it to size after. the backup goes
+    once the file is synced, on an error it stays where it is.
+*/
+long long editorCopyBackup(const char *name, struct saveJob *job){
+    char real[PATH_MAX], dir[PATH_MAX];
+    const char *filename = realpath(name, real) ? real : name;
+
+    int in = open(job->backup, O_RDONLY);
+    if(in == -1) return -1;
+    int fd = open(filename, O_WRONLY);
+    char *buf = malloc(SAVE_COPY_BUF);
+    if(buf == NULL) die("malloc");
+
+    long long copied = 0, done = job->total / 2;
+    int ok = fd != -1;
+    while(ok){
+        ssize_t n = read(in, buf, SAVE_COPY_BUF);
+        if(n == -1 && errno == EINTR) continue;
+        if(n <= 0){
+            ok = n == 0;
+            break;
+        }
+        for(ssize_t off = 0; ok && off < n;){
+            ssize_t w = write(fd, buf + off, n - off);
+            if(w == -1){
+                ok = errno == EINTR;
+                continue;
+            }
+            off += w;
+            copied += w;
+            atomic_store_explicit(&job->written, done + copied, memory_order_relaxed);
+        }
+    }
+
+    // EINVAL: not a regular file, nothing to cut or sync
+    if(ok && ((ftruncate(fd, copied) == -1 && errno != EINVAL) || (fsync(fd) == -1 && errno != EINVAL))) ok = 0;
+    int err = errno;
+    free(buf);
+    close(in);
+    if(fd != -1 && close(fd) == -1 && ok){
+        err = errno;
+        ok = 0;
+    }
+    if(!ok){
+        errno = err;
+        return -1;
+    }
+
+    unlink(job->backup);
+    const char *slash = strrchr(job->backup, '/');
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - job->backup), job->backup);
+    editorSyncDir(dir);
+    return copied;
+}
+
+/*
+    The file is normally not rewritten in place. Rows are streamed into a
+    temp file next to it, which is fsync'd and then renamed over the
+    original, so a crash or a full disk leaves either the old or the new
+    file, never a truncated one. Rows still pointing into the mapping stay
+    valid: the mapping keeps the old file's data alive after the rename.
+    A symlink is followed, the file it points to is the one replaced.
+    returns bytes written, -1 on error (errno is set).
+*/
+long long editorWriteFile(const char *name, struct saveJob *job){
+    char real[PATH_MAX], dir[PATH_MAX], tmp[PATH_MAX];
+    const char *filename = realpath(name, real) ? real : name; // a new file has no real path yet
+
+    if(job->inPlace) return editorWriteBackup(filename, job);
+
+    int fd = editorSaveTemp(filename, dir, tmp);
+    if(fd == -1) return -1;
+
+    // keep the owner and permissions of the file being replaced
+    struct stat st;
+    mode_t mode;
+    if(stat(filename, &st) == 0){
+        mode = st.st_mode & 07777;
+        if(fchown(fd, st.st_uid, st.st_gid) == -1){
+            int err = errno;
+            close(fd);
+            unlink(tmp);
+            errno = err;
+            return -1;
+        }
+    }else{
+        mode_t mask = umask(0);
+        umask(mask);
+        mode = 0644 & ~mask;
+    }
+
+    long long written;
+    if(fchmod(fd, mode) == -1 || editorWriteRows(fd, job, 0, &written) == -1 || fsync(fd) == -1){
+        int err = errno;
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    if(close(fd) == -1 || rename(tmp, filename) == -1){
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+
+    editorSyncDir(dir);
+    return written;
+}
+
+void *editorSaveWorker(void *arg){
+    struct saveJob *job = arg;
+
+    job->result = job->copying ? editorCopyBackup(job->filename, job) : editorWriteFile(job->filename, job);
+    job->err = errno;
+    atomic_store(&job->done, 1);
+    editorWake();
+    return NULL;
+}
+
+/*
+    whether the file has to be written over in place: a rename would give
+    a file with other hard links a new inode of its own, does not work
+    for anything but a regular file, and a file we could not chown back
+    to its owner would change hands.
+*/
+int editorSaveInPlace(const char *filename){
+    struct stat st;
+    if(stat(filename, &st) == -1) return 0; // new file
+
+    if(!S_ISREG(st.st_mode) || st.st_nlink > 1) return 1;
+    if(geteuid() == 0) return 0;
+    if(st.st_uid != geteuid()) return 1;
+    if(st.st_gid == getegid()) return 0;
+
+    // supplementary groups, asked for their count first
+    int n = getgroups(0, NULL);
+    gid_t *groups = malloc(sizeof(gid_t) * (n > 0 ? n : 1));
+    if(groups == NULL) die("malloc");
+    n = getgroups(n, groups);
+
+    int inPlace = 1;
+    for(int i=0;i<n;i++){
+        if(groups[i] == st.st_gid) inPlace = 0;
+    }
+    free(groups);
+    return inPlace;
+}
+
+// snapshots the rows and hands them to the writer thread
+void editorSaveStart(char *filename){
+    struct saveJob *job = &Ed.save;
+
+    job->inPlace = editorSaveInPlace(filename);
+    job->copying = 0;
+
+    job->lines = malloc(sizeof(struct iovec) * (Ed.numRows ? Ed.numRows : 1));
+    if(job->lines == NULL) die("malloc");
+    job->numLines = Ed.numRows;
+    job->total = 0;
+    for(int i=0;i<Ed.numRows;i++){
+        erow *row = editorRowAt(i);
+        if(!(row->flags & ROW_MAPPED)) row->flags |= ROW_SHARED;
+        job->lines[i].iov_base = row->data;
+        job->lines[i].iov_len = row->size;
+        job->total += row->size + 1;
+    }
+    if(job->inPlace) job->total *= 2; // once to the backup, then copied over the file
+
+    job->filename = filename;
+    job->dirtyAtStart = Ed.dirty;
+    job->numDeferred = 0;
+    job->backup = NULL;
+    atomic_store(&job->written, 0);
+    atomic_store(&job->done, 0);
+    if(pthread_create(&job->thread, NULL, editorSaveWorker, job) != 0) die("pthread_create");
+    job->active = 1;
+    TRACE("save.start", job->numLines, job->total);
+}
+
+/*
+    after a save, points the rows still as they were snapshotted into a
+    fresh mapping of the saved file, so row copies made for edits are
+    dropped and the swap file can refer to the saved file. rows edited
+    while saving keep their own buffers. must run before the snapshot
+    flags are cleared. returns 1 if it did.
+*/
+int editorRemapFile(const char *filename, long long size, struct iovec *lines, int numLines){
+    int fd = open(filename, O_RDONLY);
+    if(fd == -1) return 0;
+
+    struct stat st;
+    char *map = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size == size && size > 0){
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(map == MAP_FAILED) return 0;
+
+    editorSearchPause(); // workers must not see rows move
+
+    // an edit copies a snapshotted row first, so a row still flagged is
+    // still the same bytes as its line; those come in snapshot order
+    size_t off = 0;
+    int j = 0;
+    for(int i=0;i<Ed.numRows;i++){
+        erow *row = editorRowAt(i);
+        if(!(row->flags & (ROW_MAPPED | ROW_SHARED))) continue;
+
+        while(j < numLines && (lines[j].iov_base != row->data || (int)lines[j].iov_len != row->size)){
+            off += lines[j++].iov_len + 1;
+        }
+        if(j == numLines){ // can't happen, but the old map must not be left in use
+            editorRowMakeWritable(row);
+            continue;
+        }
+
+        editorRowFreeData(row);
+        row->data = map + off;
+        row->cap = 0;
+        row->flags = ROW_MAPPED;
+        off += lines[j++].iov_len + 1;
+    }
+
+    if(Ed.map) munmap(Ed.map, Ed.mapLen);
+    Ed.map = map;
+    Ed.mapLen = size;
+    return 1;
+}
+
+// the snapshot no longer points into row buffers, edits may free them again
+void editorSaveRelease(){
+    struct saveJob *job = &Ed.save;
+    for(int i=0;i<job->numDeferred;i++) free(job->deferred[i]);
+    job->numDeferred = 0;
+    for(int i=0;i<Ed.numRows;i++) editorRowAt(i)->flags &= ~ROW_SHARED;
+}
+
+/*
+    between the two steps of an in place save (see editorWriteBackup):
+    points the rows at the backup, which holds what they were snapshotted
+    as, so nothing reads the file while it is written over, then starts
+    the copy. an empty document has no rows in the mapping, the mapping
+    just goes. returns 0 if the rows could not be moved.
+*/
+int editorSaveCopyStart(){
+    struct saveJob *job = &Ed.save;
+
+    if(job->result > 0 && !editorRemapFile(job->backup, job->result, job->lines, job->numLines)){
+        job->result = -1;
+        job->err = errno;
+        return 0;
+    }
+    if(job->result == 0 && Ed.map){
+        munmap(Ed.map, Ed.mapLen);
+        Ed.map = NULL;
+        Ed.mapLen = 0;
+    }
+    Ed.swap.mapIsBase = 0; // the mapping is the backup now, not the file
+
+    // the snapshot is the backup's text from here on
+    size_t off = 0;
+    for(int i=0;i<job->numLines;i++){
+        job->lines[i].iov_base = Ed.map + off;
+        off += job->lines[i].iov_len + 1;
+    }
+    editorSaveRelease();
+
+    job->copying = 1;
+    atomic_store(&job->done, 0);
+    if(pthread_create(&job->thread, NULL, editorSaveWorker, job) != 0) die("pthread_create");
+    job->active = 1;
+    return 1;
+}
+
+// collects a finished save: frees what the snapshot held on to, reports
+void editorSaveFinish(){
+    struct saveJob *job = &Ed.save;
+
+    pthread_join(job->thread, NULL);
+    job->active = 0;
+    TRACE("save.end", job->result, job->err);
+
+    if(job->inPlace && !job->copying && job->result != -1 && editorSaveCopyStart()) return;
+
+    int remapped = job->result != -1 && editorRemapFile(job->filename, job->result, job->lines, job->numLines);
+
+    editorSaveRelease();
+    free(job->lines);
+    job->lines = NULL;
+
+    if(job->result == -1){
+        if(job->backup){
+            editorSetStatusMessage("Can't save! I/O error: %s, the new text is in %s", strerror(job->err), job->backup);
+        }else{
+            editorSetStatusMessage("Can't save! I/O error: %s", strerror(job->err));
+        }
+        free(job->backup);
+        job->backup = NULL;
+        return;
+    }
+    free(job->backup); // copied over the file and removed
+    job->backup = NULL;
+    editorSetStatusMessage("%lld bytes written to disk", job->result);
+
+    // the saved file is the new base of the swap file
+    if(Ed.dirty == job->dirtyAtStart){
+        Ed.dirty = 0;
+        editorSwapOpen(job->filename, remapped, 0);
+    }else{ // edited while saving, the swap file has to hold the edits
+        editorSwapOpen(job->filename, remapped, 1);
+    }
+}
+
+// blocks until a running save is over
+void editorSaveWait(){
+    while(Ed.save.active){
+        if(atomic_load(&Ed.save.done)){
+            editorSaveFinish();
+        }else{
+            struct timespec ts = {0, 1000000}; // 1ms
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+/*  For Bash on Windows, you will have to press Escape 3 times 
+    to get one Escape keypress to register in our program  
+*/
+void editorSaveFile(){
+    editorIndexFinish();
+    if(Ed.filename==NULL){
+        Ed.filename = editorPrompt("Save as: %s (ESC to cancel | Enter to save)",NULL);
+        
+        if (Ed.filename == NULL) {
+            editorRefreshScreen();
+            editorSetStatusMessage("Save aborted");
+            return;
+        }
+    }
+
+    if(Ed.save.active){
+        editorSetStatusMessage("Still saving, try again when it is done");
+        return;
+    }
+    editorSaveStart(Ed.filename);
+}
+
+/* ----- swap file ----- */
+
+/*
+    unsaved edits are journaled to .<name>.texter-swp next to the file, so they
+    survive a crash. the input thread only appends records to a buffer, a
+    writer thread flushes it every SWAP_DELAY_MS (write-behind), so typing
+    never waits for the disk.
+
+    records: 'I' y x len text, 'D' sy sx ey ex and 'C', a compaction. a
+    compaction describes the whole document as runs of unchanged lines of
+    the base file (offset, length, line count) and literal lines, so it is
+    about as big as the changes. once the journal outgrows the last
+    compaction a new one replaces the file. the header names the base file
+    (size, mtime) so a swap file is never replayed over another version.
+*/
+#define SWAP_MAGIC "TEXTERSWP1\n"
+#define SWAP_DELAY_MS 200
+#define SWAP_MIN_COMPACT (1 << 20) // journal bytes before compaction is considered
+
+void editorSwapPath(const char *filename, char *path, size_t size){
+    const char *slash = strrchr(filename, '/');
+    if(slash) snprintf(path, size, "%.*s/.%s.texter-swp", (int)(slash - filename), filename, slash + 1);
+    else snprintf(path, size, ".%s.texter-swp", filename);
+}
+
+void editorSwapHeaderFor(struct swapHeader *h, const char *filename){
+    struct stat st;
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, SWAP_MAGIC, sizeof(h->magic));
+    if(stat(filename, &st) == 0){
+        h->size = st.st_size;
+        h->mtime = st.st_mtim.tv_sec;
+        h->mtimeNsec = st.st_mtim.tv_nsec;
+    }
+}
+
+int editorWriteAll(int fd, const char *buf, size_t len){
+    while(len > 0){
+        ssize_t w = write(fd, buf, len);
+        if(w == -1){
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+// replaces the swap file with header + data, through a temp file and a rename
+int editorSwapRewrite(struct swapFile *sw, const struct swapHeader *h, const char *data, size_t len){
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", sw->path);
+
+    int fd = mkstemp(tmp);
+    if(fd == -1) return -1;
+    if(editorWriteAll(fd, (const char *)h, sizeof(*h)) == -1 || editorWriteAll(fd, data, len) == -1
+        || fdatasync(fd) == -1 || rename(tmp, sw->path) == -1){
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+
+    if(sw->fd != -1) close(sw->fd);
+    sw->fd = fd;
+    return 0;
+}
+
+void *editorSwapWriter(void *arg){
+    struct swapFile *sw = arg;
+
+    pthread_mutex_lock(&sw->lock);
+    for(;;){
+        while(!sw->quit && sw->pending.len == 0 && sw->compact == NULL) pthread_cond_wait(&sw->wake, &sw->lock);
+        int quit = sw->quit;
+
+        // let the batch grow for a while before writing it
+        if(!quit){
+            pthread_mutex_unlock(&sw->lock);
+            struct timespec ts = {0, SWAP_DELAY_MS * 1000000L};
+            nanosleep(&ts, NULL);
+            pthread_mutex_lock(&sw->lock);
+        }
+
+        struct ab_buf batch = sw->pending;
+        char *compact = sw->compact;
+        size_t compactLen = sw->compactLen;
+        struct swapHeader header = sw->header;
+        sw->pending = (struct ab_buf)ab_BUF_INIT;
+        sw->compact = NULL;
+        pthread_mutex_unlock(&sw->lock);
+
+        // the compaction already holds every record queued before it
+        if(compact){
+            editorSwapRewrite(sw, &header, compact, compactLen);
+            free(compact);
+        }
+        if(batch.len && sw->fd != -1){
+            editorWriteAll(sw->fd, batch.buf, batch.len);
+            fdatasync(sw->fd);
+        }
+        free(batch.buf);
+
+        pthread_mutex_lock(&sw->lock);
+        if(quit && sw->pending.len == 0 && sw->compact == NULL) break;
+    }
+    pthread_mutex_unlock(&sw->lock);
+    return NULL;
+}
+
+// queues a record (or a whole compaction, which drops what is queued)
+void editorSwapQueue(const char *rec, size_t len, char *compact, size_t compactLen){
+    struct swapFile *sw = &Ed.swap;
+
+    pthread_mutex_lock(&sw->lock);
+    if(compact){
+        free(sw->compact);
+        sw->compact = compact;
+        sw->compactLen = compactLen;
+        sw->pending.len = 0;
+    }
+    if(len) ab_append(&sw->pending, rec, len);
+    pthread_cond_signal(&sw->wake);
+    pthread_mutex_unlock(&sw->lock);
+}
+
+// unchanged lines of the base file, as long as they are still next to each other there
+int editorSwapRunContinues(erow *prev, erow *next){
+    if(!(prev->flags & ROW_MAPPED) || !(next->flags & ROW_MAPPED)) return 0;
+
+    char *p = prev->data + prev->size;
+    if(next->data <= p || next->data > p + 8) return 0;
+    while(p < next->data - 1 && *p == '\r') p++;
+    return p == next->data - 1 && *p == '\n';
+}
+
+// builds a compaction of the document (every row must be indexed) and
+// queues it in place of the journal
+void editorSwapCompact(){
+    struct swapFile *sw = &Ed.swap;
+    struct ab_buf b = ab_BUF_INIT;
+    int32_t n;
+    int64_t off, len;
+
+    ab_appendc(&b, 'C');
+    n = Ed.numRows;
+    ab_append(&b, (char *)&n, sizeof(n));
+
+    for(int i=0;i<Ed.numRows;){
+        erow *row = editorRowAt(i);
+        if(sw->mapIsBase && (row->flags & ROW_MAPPED)){
+            int j = i + 1;
+            while(j < Ed.numRows && editorSwapRunContinues(editorRowAt(j - 1), editorRowAt(j))) j++;
+
+            erow *last = editorRowAt(j - 1);
+            off = row->data - Ed.map;
+            len = last->data + last->size - row->data;
+            n = j - i;
+            ab_appendc(&b, 'M');
+            ab_append(&b, (char *)&off, sizeof(off));
+            ab_append(&b, (char *)&len, sizeof(len));
+            ab_append(&b, (char *)&n, sizeof(n));
+            i = j;
+        }else{
+            n = row->size;
+            ab_appendc(&b, 'L');
+            ab_append(&b, (char *)&n, sizeof(n));
+            ab_append(&b, row->data, row->size);
+            i++;
+        }
+    }
+
+    sw->journalLen = 0;
+    sw->lastCompact = b.len;
+    sw->wantCompact = 0;
+    editorSwapQueue(NULL, 0, b.buf, b.len);
+    TRACE("swap.compact", Ed.numRows, b.len);
+}
+
+void editorSwapRecord(const char *rec, size_t len){
+    struct swapFile *sw = &Ed.swap;
+
+    editorSwapQueue(rec, len, NULL, 0);
+    sw->journalLen += len;
+
+    // compacted from editorIdle, never in the middle of an edit
+    if(sw->journalLen > SWAP_MIN_COMPACT && sw->journalLen > 2 * sw->lastCompact) sw->wantCompact = 1;
+}
+
+void editorSwapRecordInsert(int y, int x, const char *s, int len){
+    if(!Ed.swap.active) return;
+
+    char head[1 + 3 * sizeof(int32_t)];
+    int32_t f[3] = {y, x, len};
+    head[0] = 'I';
+    memcpy(&head[1], f, sizeof(f));
+
+    // one record, text and all, so the writer never sees half of it
+    char *rec = malloc(sizeof(head) + len);
+    if(rec == NULL) die("malloc");
+    memcpy(rec, head, sizeof(head));
+    memcpy(&rec[sizeof(head)], s, len);
+    editorSwapRecord(rec, sizeof(head) + len);
+    free(rec);
+}
+
+void editorSwapRecordDelete(int sy, int sx, int ey, int ex){
+    if(!Ed.swap.active) return;
+
+    char rec[1 + 4 * sizeof(int32_t)];
+    int32_t f[4] = {sy, sx, ey, ex};
+    rec[0] = 'D';
+    memcpy(&rec[1], f, sizeof(f));
+    editorSwapRecord(rec, sizeof(rec));
+}
+
+/*
+    starts journaling for filename: a fresh swap file, empty if the
+    document is the file as it is on disk, else (withDoc) holding a
+    compaction of the document.
+*/
+void editorSwapOpen(const char *filename, int mapIsBase, int withDoc){
+    struct swapFile *sw = &Ed.swap;
+    if(sw->off) return;
+
+    if(!sw->active){
+        sw->path = malloc(PATH_MAX);
+        if(sw->path == NULL) die("malloc");
+        sw->fd = -1;
+        sw->quit = 0;
+        sw->pending = (struct ab_buf)ab_BUF_INIT;
+        sw->compact = NULL;
+        pthread_mutex_init(&sw->lock, NULL);
+        pthread_cond_init(&sw->wake, NULL);
+        editorSwapPath(filename, sw->path, PATH_MAX);
+        if(pthread_create(&sw->thread, NULL, editorSwapWriter, sw) != 0) die("pthread_create");
+        sw->active = 1;
+    }
+
+    pthread_mutex_lock(&sw->lock);
+    editorSwapHeaderFor(&sw->header, filename);
+    pthread_mutex_unlock(&sw->lock);
+    sw->mapIsBase = mapIsBase;
+
+    if(withDoc){
+        editorSwapCompact();
+    }else{
+        char *empty = malloc(1);
+        if(empty == NULL) die("malloc");
+        sw->journalLen = 0;
+        sw->lastCompact = 0;
+        sw->wantCompact = 0;
+        editorSwapQueue(NULL, 0, empty, 0);
+    }
+}
+
+// stops the writer after it flushed everything, the file goes on a clean exit
+void editorSwapClose(int remove){
+    struct swapFile *sw = &Ed.swap;
+    if(!sw->active) return;
+
+    pthread_mutex_lock(&sw->lock);
+    sw->quit = 1;
+    pthread_cond_signal(&sw->wake);
+    pthread_mutex_unlock(&sw->lock);
+    pthread_join(sw->thread, NULL);
+
+    if(sw->fd != -1) close(sw->fd);
+    if(remove) unlink(sw->path);
+    sw->active = 0;
+}
+
+int editorSwapRead(const char **p, const char *end, void *out, size_t len){
+    if((size_t)(end - *p) < len) return 0;
+    memcpy(out, *p, len);
+    *p += len;
+    return 1;
+}
+
+// whether (y,x) is a position in the document, y == numRows with x == 0 is the end
+int editorSwapPosOk(int y, int x){
+    if(y == Ed.numRows) return x == 0;
+    return y >= 0 && y < Ed.numRows && x >= 0 && x <= editorRowAt(y)->size;
+}
+
+/*
+    applies the records of a swap file. stops at the first incomplete or
+    out of range one, a damaged file must not take the editor down with
+    it. records counts the ones applied, returns 1 if that was all of them.
+*/
+int editorSwapReplay(const char *p, const char *end, int *records){
+    int32_t f[4];
+    int64_t off, len;
+    int y, x;
+
+    *records = 0;
+    while(p < end){
+        char type = *p++;
+
+        if(type == 'I'){
+            if(!editorSwapRead(&p, end, f, 3 * sizeof(int32_t)) || f[2] < 0 || end - p < f[2]) return 0;
+            if(!editorSwapPosOk(f[0], f[1])) return 0;
+            editorInsertText(f[0], f[1], p, f[2], &y, &x);
+            p += f[2];
+        }else if(type == 'D'){
+            if(!editorSwapRead(&p, end, f, 4 * sizeof(int32_t))) return 0;
+            if(f[2] >= Ed.numRows || !editorSwapPosOk(f[0], f[1]) || !editorSwapPosOk(f[2], f[3])) return 0;
+            if(f[0] > f[2] || (f[0] == f[2] && f[1] > f[3])) return 0;
+            editorDeleteRange(f[0], f[1], f[2], f[3]);
+        }else if(type == 'C'){
+            if(!editorSwapRead(&p, end, f, sizeof(int32_t))) return 0;
+            editorDeleteRows(0, Ed.numRows);
+
+            while(Ed.numRows < f[0]){
+                char kind;
+                if(!editorSwapRead(&p, end, &kind, 1)) return 0;
+
+                if(kind == 'M'){
+                    if(!editorSwapRead(&p, end, &off, sizeof(off)) || !editorSwapRead(&p, end, &len, sizeof(len))
+                        || !editorSwapRead(&p, end, &f[1], sizeof(int32_t))) return 0;
+                    if(off < 0 || len < 0 || (size_t)off > Ed.mapLen || (size_t)len > Ed.mapLen - off) return 0;
+
+                    char *q = Ed.map + off, *runEnd = q + len;
+                    for(int i=0;i<f[1];i++){
+                        char *nl = memchr(q, '\n', runEnd - q);
+                        char *lineEnd = nl ? nl : runEnd;
+                        while(lineEnd > q && lineEnd[-1]=='\r') lineEnd--;
+                        editorAppendMappedRow(q, lineEnd - q);
+                        q = nl ? nl + 1 : runEnd;
+                    }
+                }else if(kind == 'L'){
+                    if(!editorSwapRead(&p, end, &f[1], sizeof(int32_t)) || f[1] < 0 || end - p < f[1]) return 0;
+                    char *data = malloc(f[1] + 1);
+                    if(data == NULL) die("malloc");
+                    memcpy(data, p, f[1]);
+                    data[f[1]] = '\0';
+                    editorInsertRowOwned(data, f[1], Ed.numRows);
+                    p += f[1];
+                }else{
+                    return 0;
+                }
+            }
+        }else{
+            return 0;
+        }
+        (*records)++;
+    }
+    return 1;
+}
+
+/*
+    called on open: if filename has a swap file from an earlier session,
+    offers to recover it. then starts a swap file for this session. a
+    swap file that does not belong to the file as it is now is moved
+    aside to .<name>.texter-swp.old first, it may be the only copy of the
+    edits. a file there that is not a texter swap file is left alone.
+*/
+void editorSwapRecover(const char *filename){
+    char path[PATH_MAX];
+    int recovered = 0, stale = 0, foreign = 0;
+    editorSwapPath(filename, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd != -1 && fstat(fd, &st) == -1) foreign = 1; // cant tell whose it is
+    else if(fd != -1 && st.st_size > 0){
+        char *buf = malloc(st.st_size);
+        struct swapHeader h, now;
+        editorSwapHeaderFor(&now, filename);
+
+        if(buf == NULL || read(fd, buf, st.st_size) != st.st_size){
+            foreign = 1;
+        }else if(st.st_size < (off_t)sizeof(h.magic) || memcmp(buf, SWAP_MAGIC, sizeof(h.magic)) != 0){
+            foreign = 1; // someone else's file, maybe another editor's
+        }else if(st.st_size <= (off_t)sizeof(h)){
+            // only a header, no edits to recover
+        }else{
+            memcpy(&h, buf, sizeof(h));
+            if(memcmp(&h, &now, sizeof(h)) != 0){
+                stale = 1;
+            }else{
+                char *answer = editorPrompt("Found unsaved changes in a swap file, recover them? (y/n): %s", NULL);
+                if(answer && (answer[0] == 'y' || answer[0] == 'Y')){
+                    editorIndexFinish();
+                    int records;
+                    if(editorSwapReplay(buf + sizeof(h), buf + st.st_size, &records)){
+                        editorSetStatusMessage("Recovered unsaved changes from %s", path);
+                    }else{
+                        editorSetStatusMessage("Recovered %d edits from %s, the rest of it is damaged", records, path);
+                    }
+                    recovered = 1;
+                }
+                free(answer);
+            }
+        }
+        free(buf);
+    }
+    if(fd != -1) close(fd);
+
+    if(foreign){
+        editorSetStatusMessage("%s is not a texter swap file, not journaling", path);
+        Ed.swap.off = 1;
+        return;
+    }
+    if(stale){
+        char old[PATH_MAX + 4];
+        snprintf(old, sizeof(old), "%s.old", path);
+        if(rename(path, old) == -1){
+            // no journal this session rather than writing over it
+            editorSetStatusMessage("Can't move %s aside: %s, not journaling", path, strerror(errno));
+            Ed.swap.off = 1;
+            return;
+        }
+        editorSetStatusMessage("Swap file is for another version of the file, kept as %s", old);
+    }
+    editorSwapOpen(filename, 1, recovered);
+}
+
+/* ----- regex ----- */
+
+/*
+    regex search. the pattern is parsed to a tree, the tree is turned into
+    two nfas: one reading a row backwards and unanchored, one reading
+    forwards from a given start. both run as lazy dfas: a dfa state (a set
+    of nfa states) is built the first time a byte leads to it and cached,
+    so after warm up every byte of a row is one table lookup and there is
+    no backtracking. the backward pass marks every position a match can
+    start at, the forward pass takes the longest match from the leftmost
+    of them. rows that lack the longest literal of the pattern are skipped
+    before either pass.
+    supported: literals . [] [^] * + ? | () ^ $ and \d \w \s \D \W \S
+*/
+#define RE_SET 0   // consume one byte of a set
+#define RE_SPLIT 1 // epsilon to out and out1
+#define RE_BOL 2   // epsilon, only at the start of the row
+#define RE_EOL 3   // epsilon, only at the end of the row
+#define RE_MATCH 4
+#define RE_CAT 5   // tree only from here on
+#define RE_ALT 6
+#define RE_STAR 7
+#define RE_PLUS 8
+#define RE_QUEST 9
+#define RE_EMPTY 10
+
+#define RE_DFA_STATES 1024 // dfa states cached before the cache is flushed
+
+struct reNode {
+    int type;
+    int a, b; // children, for RE_SET a is the set
+};
+
+struct reState {
+    int type;
+    int out, out1;
+    int set;
+};
+
+struct reNfa {
+    struct reState *st;
+    int num, cap;
+    int start;
+};
+
+struct regex {
+    struct reNode *nodes;
+    int numNodes, capNodes;
+    uint8_t (*sets)[32]; // byte bitmaps
+    int numSets, capSets;
+
+    struct reNfa fwd, rev;
+    char lit[64]; // longest literal every match contains
+    int litLen;
+};
+
+struct reDfaState {
+    int set, n;     // its nfa states, in the dfa pool
+    int match;      // a match ends here
+    int matchAtEnd; // a match ends here if this is the end of the row
+    int next[256];  // -1 until first needed
+};
+
+struct reDfa {
+    const struct regex *re;
+    const struct reNfa *nfa;
+
+    struct reDfaState *states;
+    int num;
+    int flushes;
+    int *pool;
+    int poolLen, poolCap;
+    int table[RE_DFA_STATES * 2]; // set hash -> state, -1 if empty
+    int start[2]; // start state, by "at start of row"
+
+    int *stack, *mark, *tmp, *buf; // closure scratch
+    int gen;
+};
+
+// one per thread, dfa caches are not shared
+struct reMatcher {
+    struct reDfa fwd, rev;
+    uint8_t *starts;
+    int startsCap;
+};
+
+struct reParser {
+    struct regex *re;
+    const char *p;
+    int err;
+};
+
+int regexNode(struct regex *re, int type, int a, int b){
+    if(re->numNodes == re->capNodes){
+        re->capNodes = re->capNodes ? re->capNodes * 2 : 64;
+        re->nodes = realloc(re->nodes, sizeof(struct reNode) * re->capNodes);
+        if(re->nodes == NULL) die("realloc");
+    }
+    re->nodes[re->numNodes] = (struct reNode){type, a, b};
+    return re->numNodes++;
+}
+
+int regexNewSet(struct regex *re){
+    if(re->numSets == re->capSets){
+        re->capSets = re->capSets ? re->capSets * 2 : 16;
+        re->sets = realloc(re->sets, sizeof(*re->sets) * re->capSets);
+        if(re->sets == NULL) die("realloc");
+    }
+    memset(re->sets[re->numSets], 0, sizeof(*re->sets));
+    return re->numSets++;
+}
+
+#define RE_SET_ADD(set, c) ((set)[(c) >> 3] |= 1 << ((c) & 7))
+#define RE_SET_HAS(set, c) ((set)[(c) >> 3] & (1 << ((c) & 7)))
+
+// adds \d \w \s (negated when upper case) to set, 0 if c is none of them
+int regexClassEscape(uint8_t *set, int c){
+    int neg = isupper(c) != 0;
+    c = tolower(c);
+    if(c != 'd' && c != 'w' && c != 's') return 0;
+
+    for(int i=0;i<256;i++){
+        int in = c == 'd' ? isdigit(i) : c == 'w' ? isalnum(i) || i == '_' : isspace(i);
+        if((in != 0) != neg) RE_SET_ADD(set, i);
+    }
+    return 1;
+}
+
+int regexEscapeChar(int c){
+    return c == 'n' ? '\n' : c == 't' ? '\t' : c;
+}
+
+int regexParseAlt(struct reParser *ps);
+
+int regexParseClass(struct reParser *ps){
+    struct regex *re = ps->re;
+    int s = regexNewSet(re), neg = 0, first = 1;
+
+    if(*ps->p == '^'){
+        neg = 1;
+        ps->p++;
+    }
+    while(*ps->p && (*ps->p != ']' || first)){ // a leading ']' is literal
+        first = 0;
+        int c = (unsigned char)*ps->p++;
+        if(c == '\\' && *ps->p){
+            c = (unsigned char)*ps->p++;
+            if(regexClassEscape(re->sets[s], c)) continue;
+            c = regexEscapeChar(c);
+        }
+
+        int hi = c;
+        if(ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']'){ // range
+            hi = (unsigned char)ps->p[1];
+            ps->p += 2;
+            if(hi == '\\' && *ps->p) hi = regexEscapeChar((unsigned char)*ps->p++);
+            if(hi < c){
+                ps->err = 1;
+                return -1;
+            }
+        }
+        for(int i=c;i<=hi;i++) RE_SET_ADD(re->sets[s], i);
+    }
+
+    if(*ps->p != ']'){
+        ps->err = 1;
+        return -1;
+    }
+    ps->p++;
+    if(neg) for(int i=0;i<32;i++) re->sets[s][i] ^= 0xff;
+    return regexNode(re, RE_SET, s, 0);
+}
+
+int regexParseAtom(struct reParser *ps){
+    struct regex *re = ps->re;
+    int c = (unsigned char)*ps->p++, s, n;
+
+    switch(c){
+        case '(':
+            n = regexParseAlt(ps);
+            if(ps->err || *ps->p != ')'){
+                ps->err = 1;
+                return -1;
+            }
+            ps->p++;
+            return n;
+        case '[':
+            return regexParseClass(ps);
+        case '.':
+            s = regexNewSet(re);
+            memset(re->sets[s], 0xff, sizeof(*re->sets));
+            return regexNode(re, RE_SET, s, 0);
+        case '^':
+            return regexNode(re, RE_BOL, 0, 0);
+        case '$':
+            return regexNode(re, RE_EOL, 0, 0);
+        case '\\':
+            if(*ps->p == '\0') break;
+            c = (unsigned char)*ps->p++;
+            s = regexNewSet(re);
+            if(!regexClassEscape(re->sets[s], c)) RE_SET_ADD(re->sets[s], regexEscapeChar(c));
+            return regexNode(re, RE_SET, s, 0);
+        case '*':
+        case '+':
+        case '?':
+            break; // nothing to repeat
+        default:
+            s = regexNewSet(re);
+            RE_SET_ADD(re->sets[s], c);
+            return regexNode(re, RE_SET, s, 0);
+    }
+    ps->err = 1;
+    return -1;
+}
+
+int regexParseRepeat(struct reParser *ps){
+    int n = regexParseAtom(ps);
+
+    while(!ps->err && (*ps->p == '*' || *ps->p == '+' || *ps->p == '?')){
+        int c = *ps->p++;
+        n = regexNode(ps->re, c == '*' ? RE_STAR : c == '+' ? RE_PLUS : RE_QUEST, n, 0);
+    }
+    return n;
+}
+
+int regexParseCat(struct reParser *ps){
+    int n = regexNode(ps->re, RE_EMPTY, 0, 0);
+
+    while(!ps->err && *ps->p && *ps->p != '|' && *ps->p != ')'){
+        int r = regexParseRepeat(ps);
+        n = regexNode(ps->re, RE_CAT, n, r);
+    }
+    return n;
+}
+
+int regexParseAlt(struct reParser *ps){
+    int n = regexParseCat(ps);
+
+    while(!ps->err && *ps->p == '|'){
+        ps->p++;
+        int r = regexParseCat(ps);
+        n = regexNode(ps->re, RE_ALT, n, r);
+    }
+    return n;
+}
+
+/*
+    finds the longest run of single byte sets in the concatenation at the
+    top of the tree. every match contains it, so rows without it are skipped.
+*/
+void regexFindLiteral(struct regex *re, int n, char *run, int *runLen){
+    struct reNode node = re->nodes[n];
+
+    if(node.type == RE_CAT){
+        regexFindLiteral(re, node.a, run, runLen);
+        regexFindLiteral(re, node.b, run, runLen);
+        return;
+    }
+    if(node.type == RE_EMPTY || node.type == RE_BOL || node.type == RE_EOL) return;
+
+    int c = -1;
+    if(node.type == RE_SET){
+        for(int i=0;i<256;i++){
+            if(!RE_SET_HAS(re->sets[node.a], i)) continue;
+            if(c >= 0){
+                c = -1;
+                break;
+            }
+            c = i;
+        }
+    }
+    if(c < 0 || *runLen == (int)sizeof(re->lit)){ // anything else ends the run
+        *runLen = 0;
+        return;
+    }
+
+    run[(*runLen)++] = c;
+    if(*runLen > re->litLen){
+        memcpy(re->lit, run, *runLen);
+        re->litLen = *runLen;
+    }
+}
+
+int regexState(struct reNfa *nfa, int type, int out, int out1, int set){
+    if(nfa->num == nfa->cap){
+        nfa->cap = nfa->cap ? nfa->cap * 2 : 64;
+        nfa->st = realloc(nfa->st, sizeof(struct reState) * nfa->cap);
+        if(nfa->st == NULL) die("realloc");
+    }
+    nfa->st[nfa->num] = (struct reState){type, out, out1, set};
+    return nfa->num++;
+}
+
+// emits tree n so it continues to state next, reversed if rev. returns the entry state
+int regexEmit(struct regex *re, struct reNfa *nfa, int n, int next, int rev){
+    struct reNode node = re->nodes[n];
+    int s, x, y;
+
+    switch(node.type){
+        case RE_SET:
+            return regexState(nfa, RE_SET, next, -1, node.a);
+        case RE_BOL:
+            return regexState(nfa, rev ? RE_EOL : RE_BOL, next, -1, 0);
+        case RE_EOL:
+            return regexState(nfa, rev ? RE_BOL : RE_EOL, next, -1, 0);
+        case RE_CAT:
+            if(rev) return regexEmit(re, nfa, node.b, regexEmit(re, nfa, node.a, next, rev), rev);
+            return regexEmit(re, nfa, node.a, regexEmit(re, nfa, node.b, next, rev), rev);
+        case RE_ALT:
+            x = regexEmit(re, nfa, node.a, next, rev);
+            y = regexEmit(re, nfa, node.b, next, rev);
+            return regexState(nfa, RE_SPLIT, x, y, 0);
+        case RE_QUEST:
+            x = regexEmit(re, nfa, node.a, next, rev);
+            return regexState(nfa, RE_SPLIT, x, next, 0);
+        case RE_STAR:
+        case RE_PLUS:
+            s = regexState(nfa, RE_SPLIT, -1, next, 0);
+            x = regexEmit(re, nfa, node.a, s, rev);
+            nfa->st[s].out = x;
+            return node.type == RE_STAR ? s : x;
+    }
+    return next; // RE_EMPTY
+}
+
+void regexFree(struct regex *re){
+    if(re == NULL) return;
+    free(re->nodes);
+    free(re->sets);
+    free(re->fwd.st);
+    free(re->rev.st);
+    free(re);
+}
+
+// NULL if the pattern is not valid
+struct regex *regexCompile(const char *pattern){
+    struct regex *re = calloc(1, sizeof(struct regex));
+    if(re == NULL) die("calloc");
+
+    struct reParser ps = {re, pattern, 0};
+    int root = regexParseAlt(&ps);
+    if(ps.err || *ps.p != '\0'){
+        regexFree(re);
+        return NULL;
+    }
+
+    char run[sizeof(re->lit)];
+    int runLen = 0;
+    regexFindLiteral(re, root, run, &runLen);
+
+    int m = regexState(&re->fwd, RE_MATCH, -1, -1, 0);
+    re->fwd.start = regexEmit(re, &re->fwd, root, m, 0);
+
+    // backwards, with a loop over any byte in front so it is unanchored
+    m = regexState(&re->rev, RE_MATCH, -1, -1, 0);
+    int start = regexEmit(re, &re->rev, root, m, 1);
+    int any = regexNewSet(re);
+    memset(re->sets[any], 0xff, sizeof(*re->sets));
+    int loop = regexState(&re->rev, RE_SPLIT, start, -1, 0);
+    re->rev.st[loop].out1 = regexState(&re->rev, RE_SET, loop, -1, any);
+    re->rev.start = loop;
+    return re;
+}
+
+void regexDfaFlush(struct reDfa *d){
+    d->num = 0;
+    d->poolLen = 0;
+    d->flushes++;
+    memset(d->table, 0xff, sizeof(d->table));
+    d->start[0] = d->start[1] = -1;
+}
+
+void regexDfaInit(struct reDfa *d, const struct regex *re, const struct reNfa *nfa){
+    memset(d, 0, sizeof(*d));
+    d->re = re;
+    d->nfa = nfa;
+    d->states = malloc(sizeof(struct reDfaState) * RE_DFA_STATES);
+    d->stack = malloc(sizeof(int) * nfa->num);
+    d->mark = calloc(nfa->num, sizeof(int));
+    d->tmp = malloc(sizeof(int) * nfa->num);
+    d->buf = malloc(sizeof(int) * nfa->num);
+    if(!d->states || !d->stack || !d->mark || !d->tmp || !d->buf) die("malloc");
+    regexDfaFlush(d);
+}
+
+void regexDfaFree(struct reDfa *d){
+    free(d->states);
+    free(d->pool);
+    free(d->stack);
+    free(d->mark);
+    free(d->tmp);
+    free(d->buf);
+}
+
+int regexIntCmp(const void *a, const void *b){
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+    follows the epsilon edges from the states in in[], into d->buf (sorted).
+    only states that consume a byte, wait for the row end or match are
+    kept. sets *match if the match state is reached.
+*/
+int regexClosure(struct reDfa *d, const int *in, int n, int bol, int eol, int *match){
+    const struct reState *st = d->nfa->st;
+    int top = 0, cnt = 0;
+
+    *match = 0;
+    d->gen++;
+    for(int i=0;i<n;i++){
+        if(d->mark[in[i]] != d->gen){
+            d->mark[in[i]] = d->gen;
+            d->stack[top++] = in[i];
+        }
+    }
+
+    while(top){
+        int s = d->stack[--top], next[2] = {-1, -1};
+
+        switch(st[s].type){
+            case RE_SPLIT:
+                next[0] = st[s].out;
+                next[1] = st[s].out1;
+                break;
+            case RE_BOL:
+                if(bol) next[0] = st[s].out;
+                break;
+            case RE_EOL:
+                if(eol) next[0] = st[s].out;
+                else d->buf[cnt++] = s;
+                break;
+            case RE_MATCH:
+                *match = 1;
+                d->buf[cnt++] = s;
+                break;
+            default:
+                d->buf[cnt++] = s;
+        }
+
+        for(int i=0;i<2;i++){
+            if(next[i] >= 0 && d->mark[next[i]] != d->gen){
+                d->mark[next[i]] = d->gen;
+                d->stack[top++] = next[i];
+            }
+        }
+    }
+
+    qsort(d->buf, cnt, sizeof(int), regexIntCmp);
+    return cnt;
+}
+
+// the dfa state for the nfa states set[], made if new
+int regexDfaAdd(struct reDfa *d, const int *set, int n, int match){
+    unsigned h = 2166136261u;
+    for(int i=0;i<n;i++) h = (h ^ set[i]) * 16777619u;
+
+    int mask = RE_DFA_STATES * 2 - 1, i;
+    for(i = h & mask; d->table[i] >= 0; i = (i + 1) & mask){
+        struct reDfaState *ds = &d->states[d->table[i]];
+        if(ds->n == n && memcmp(&d->pool[ds->set], set, sizeof(int) * n) == 0) return d->table[i];
+    }
+
+    if(d->num == RE_DFA_STATES){ // cache full, start over
+        regexDfaFlush(d);
+        i = h & mask;
+    }
+
+    if(d->poolLen + n > d->poolCap){
+        d->poolCap = d->poolCap ? d->poolCap * 2 : 1024;
+        while(d->poolCap < d->poolLen + n) d->poolCap *= 2;
+        d->pool = realloc(d->pool, sizeof(int) * d->poolCap);
+        if(d->pool == NULL) die("realloc");
+    }
+    memcpy(&d->pool[d->poolLen], set, sizeof(int) * n);
+
+    struct reDfaState *ds = &d->states[d->num];
+    ds->set = d->poolLen;
+    ds->n = n;
+    ds->match = match;
+    memset(ds->next, 0xff, sizeof(ds->next));
+    d->poolLen += n;
+
+    // would one of the waiting $ let it match
+    regexClosure(d, &d->pool[ds->set], n, 0, 1, &ds->matchAtEnd);
+    ds->matchAtEnd |= match;
+
+    d->table[i] = d->num;
+    return d->num++;
+}
 
-    // printing file name
-    char status[80], curStatus[80];
-    int len = snprintf(status, sizeof(status), "%.20s - %d lines %s", Ed.filename, Ed.numRows, Ed.dirty ? "(modified)" : "");
-    int rlen = snprintf(curStatus, sizeof(curStatus), "%d/%d", Ed.cy+1, Ed.numRows);
+int regexDfaStart(struct reDfa *d, int bol){
+    if(d->start[bol] < 0){
+        int match, n = regexClosure(d, &d->nfa->start, 1, bol, 0, &match);
+        int s = regexDfaAdd(d, d->buf, n, match);
+        d->start[bol] = s;
+    }
+    return d->start[bol];
+}
 
-    ab_append(b, status, len);
+int regexDfaStep(struct reDfa *d, int s, int c){
+    if(d->states[s].next[c] >= 0) return d->states[s].next[c];
 
-    while (len < Ed.screenCols + GetLineNoBarWidth()) {
-        if (Ed.screenCols + GetLineNoBarWidth() - len == rlen) {
-            ab_append(b, curStatus, rlen);
-            break;
-        } else {
-            ab_append(b, " ", 1);
-            len++;
-        }
+    const struct reState *st = d->nfa->st;
+    const int *set = &d->pool[d->states[s].set];
+    int n = 0, match;
+    for(int i=0;i<d->states[s].n;i++){
+        if(st[set[i]].type == RE_SET && RE_SET_HAS(d->re->sets[st[set[i]].set], c)) d->tmp[n++] = st[set[i]].out;
     }
-    ab_append(b, "\x1b[m", 3);
-    ab_append(b, "\r\n", 2);
 
+    int flushes = d->flushes;
+    n = regexClosure(d, d->tmp, n, 0, 0, &match);
+    int next = regexDfaAdd(d, d->buf, n, match);
+    if(d->flushes == flushes) d->states[s].next[c] = next; // s is gone after a flush
+    return next;
 }
 
-void editorDrawLineNos(struct ab_buf *b, int id){
-    ab_append(b, "\x1b[1m",  4); // bold
-    ab_append(b, "\x1b[48;5;15m", 10); // bg
-    ab_append(b, "\x1b[38;5;16m", 10); // text
-    // ab_append(b, "\x1b[4m",  4); // underline
-
-    char s[20]; 
-    snprintf(s, sizeof(s), "%*d", GetLineNoBarWidth(), Ed.row[id].lineNo); 
-    ab_append(b, s, GetLineNoBarWidth()); 
-    
-    ab_append(b, "\x1b[m", 3);
+void regexMatcherInit(struct reMatcher *mt, const struct regex *re){
+    regexDfaInit(&mt->fwd, re, &re->fwd);
+    regexDfaInit(&mt->rev, re, &re->rev);
+    mt->starts = NULL;
+    mt->startsCap = 0;
 }
 
-void editorDrawRows(struct ab_buf *b) {
-    int y;
+void regexMatcherFree(struct reMatcher *mt){
+    regexDfaFree(&mt->fwd);
+    regexDfaFree(&mt->rev);
+    free(mt->starts);
+}
 
-    for (y = 0; y < Ed.screenRows; y++) {
-        int realY = y + Ed.scrollYOffset;
+// backward pass, marks in mt->starts where matches can start. 0 if nowhere
+int regexStarts(struct reMatcher *mt, const char *s, int len){
+    if(len + 1 > mt->startsCap){
+        mt->startsCap = len + 1 > 2 * mt->startsCap ? len + 1 : 2 * mt->startsCap;
+        mt->starts = realloc(mt->starts, mt->startsCap);
+        if(mt->starts == NULL) die("realloc");
+    }
 
-        if(realY >= Ed.numRows){
-            
-            // set colors for line no side bar.
-            ab_append(b, "\x1b[1m",  4); // bold
-            ab_append(b, "\x1b[48;5;15m", 10); // bg
-            ab_append(b, "\x1b[38;5;16m", 10); // text
-
-            // we only show wlcm msg when user open empty editor
-            if (y == Ed.screenRows / 2 && !Ed.START) {
-
-                char welcome[80];
-                int welcomelen = snprintf(welcome, sizeof(welcome), "TEXTER -- version %s", TEXTER_VERSION);
-                if (welcomelen > Ed.screenCols) welcomelen = Ed.screenCols;
-
-                
-                int padding = (Ed.screenCols - welcomelen) / 2;
-                if (padding) {
-                    ab_append(b, "~", GetLineNoBarWidth());
-                    padding--;
-                }
+    struct reDfa *d = &mt->rev;
+    int st = regexDfaStart(d, 1), found = 0;
+    for(int q=len;;q--){
+        struct reDfaState *ds = &d->states[st];
+        int m = ds->match || (q == 0 && ds->matchAtEnd);
+        mt->starts[q] = m;
+        found |= m;
+        if(q == 0) break;
+        st = regexDfaStep(d, st, (unsigned char)s[q - 1]);
+    }
+    return found;
+}
 
-                ab_append(b, "\x1b[m", 3); // reset color setting
-                while (padding--) ab_append(b, " ", 1);
+// end of the longest match starting at from, -1 if none
+int regexLongest(struct reMatcher *mt, const char *s, int len, int from){
+    struct reDfa *d = &mt->fwd;
+    int st = regexDfaStart(d, from == 0), end = -1;
 
-                
-                ab_append(b, welcome, welcomelen);
-            } else { // printing tildes
-                ab_append(b, "~", GetLineNoBarWidth());
-            }
+    for(int q=from;;q++){
+        struct reDfaState *ds = &d->states[st];
+        if(ds->match || (q == len && ds->matchAtEnd)) end = q;
+        if(q == len || ds->n == 0) break;
+        st = regexDfaStep(d, st, (unsigned char)s[q]);
+    }
+    return end;
+}
 
-            ab_append(b, "\x1b[m", 3);
+/* ----- search ----- */
 
-            
-        }else{
-            editorDrawLineNos(b, realY);
+/*
+    first occurrence of needle in hay, -1 if none. candidates are found 16
+    positions at a time by comparing the first and the last byte of the
+    needle, only those get a full compare. the rest is memchr on the
+    first byte.
+*/
+int editorSearchFind(const char *hay, int hayLen, const char *needle, int n){
+    if(n == 0 || n > hayLen) return -1;
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[n - 1]);
+
+    for(; i + n - 1 + 16 <= hayLen; i += 16){
+        __m128i a = _mm_loadu_si128((const __m128i *)&hay[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&hay[i + n - 1]);
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+        while(mask){
+            int at = i + __builtin_ctz(mask);
+            if(memcmp(&hay[at], needle, n) == 0) return at;
+            mask &= mask - 1;
+        }
+    }
+#endif
 
-            // setting screen bg color to bluish
-            ab_append(b, "\x1b[48;5;53m", 10);
-            ab_append(b, "\x1b[38;5;15m", 10); // text
+    while(i + n <= hayLen){
+        const char *p = memchr(&hay[i], needle[0], hayLen - n + 1 - i);
+        if(p == NULL) return -1;
+        i = p - hay;
+        if(hay[i + n - 1] == needle[n - 1] && memcmp(&hay[i], needle, n) == 0) return i;
+        i++;
+    }
+    return -1;
+}
 
-            int len = Ed.row[realY].rSize - Ed.scrollXOffset;
+void editorSearchAdd(struct searchChunk *ch, int y, int x, int len){
+    if(ch->count == ch->cap){
+        ch->cap = ch->cap ? ch->cap * 2 : 64;
+        ch->m = realloc(ch->m, sizeof(struct searchMatch) * ch->cap);
+        if(ch->m == NULL) die("realloc");
+    }
+    ch->m[ch->count].y = y;
+    ch->m[ch->count].x = x;
+    ch->m[ch->count].len = len;
+    ch->count++;
+}
 
-            // truncate data lines to screenCols
-            if(len < 0) len = 0;
-            if (len > Ed.screenCols) len = Ed.screenCols;
+// regex matches of a row, leftmost longest, empty matches are skipped
+void editorSearchRegexRow(struct searchState *st, struct reMatcher *mt, struct searchChunk *ch, int y){
+    erow *row = editorRowAt(y);
 
-            char *c = &Ed.row[realY].renderData[Ed.scrollXOffset];
+    if(st->re->litLen && editorSearchFind(row->data, row->size, st->re->lit, st->re->litLen) < 0) return;
+    if(!regexStarts(mt, row->data, row->size)) return;
 
-            // iterating char by char to detect digits
-            for(int i=0;i<len;i++){
+    int x = 0;
+    while(x < row->size){
+        while(x < row->size && !mt->starts[x]) x++;
+        if(x == row->size) break;
 
-                // check if its currently selected or not.
-                // to paint it.
-                if(Ed.selected){
-                    editorPaintSelectedData(b,i,realY,&Ed.row[realY]);
-                }
+        int end = regexLongest(mt, row->data, row->size, x);
+        if(end > x){
+            editorSearchAdd(ch, y, x, end - x);
+            x = end;
+        }else{
+            x++;
+        }
+    }
+}
 
-                if(isdigit(c[i])){  // coloring digits
-                    ab_append(b, "\x1b[38;5;46m", 11); // text
-                    ab_append(b, &c[i], 1);
-                    ab_append(b, "\x1b[39m", 5);
-                }else{
-                    ab_append(b, &c[i], 1);
-                }
+// mt is the calling thread's regex matcher, only used in regex mode
+void editorSearchScanChunk(struct searchState *st, struct searchChunk *ch, struct reMatcher *mt){
+    if(st->regex && st->re == NULL) return; // invalid regex matches nothing
 
+    for(int y = ch->start; y < ch->end; y++){
+        if(atomic_load_explicit(&st->cancel, memory_order_relaxed)) return;
 
-                // again setting screen bg color to bluish and text white
-                ab_append(b, "\x1b[48;5;53m", 10); // bg
-                ab_append(b, "\x1b[38;5;15m", 10); // text
-            }
+        if(st->regex){
+            editorSearchRegexRow(st, mt, ch, y);
+            continue;
         }
 
-        ab_append(b, "\x1b[K", 3);
-        ab_append(b, "\r\n", 2);
+        erow *row = editorRowAt(y);
+        int x = 0, at;
+        while((at = editorSearchFind(&row->data[x], row->size - x, st->query, st->qlen)) >= 0){
+            editorSearchAdd(ch, y, x + at, st->qlen);
+            x += at + 1;
+        }
     }
+}
 
+void *editorSearchWorker(void *arg){
+    struct searchState *st = arg;
+    struct reMatcher mt;
+    int k;
+
+    if(st->re) regexMatcherInit(&mt, st->re);
+    while((k = atomic_fetch_add(&st->nextChunk, 1)) < st->numChunks){
+        editorSearchScanChunk(st, &st->chunks[k], &mt);
+        if(atomic_load(&st->cancel)) break; // cut short, it is scanned again on resume
+        atomic_store(&st->chunks[k].done, 1);
+        TRACE("search.chunk", k, st->chunks[k].count);
+        editorWake();
+    }
+    if(st->re) regexMatcherFree(&mt);
+    return NULL;
 }
 
-void editorScroll() {
-    // calculating rx using cx
-    Ed.rx = Ed.cx;
-    if(Ed.cy < Ed.numRows) Ed.rx = editorCxToRx(&Ed.row[Ed.cy], Ed.cx);
+// cancels a running scan and forgets all matches
+void editorSearchStop(){
+    struct searchState *st = &Ed.search;
 
-    // when we try to move up, it decreases the offsetY, 
-    // so that we can view code from that desired cursor pos.
-    if (Ed.cy < Ed.scrollYOffset) {
-        Ed.scrollYOffset = Ed.cy;
+    if(st->active){
+        atomic_store(&st->cancel, 1);
+        for(int i=0;i<st->numThreads;i++) pthread_join(st->threads[i], NULL);
+        st->active = 0;
     }
-
-    // same thing for scroll down, [to view content below when scrolling down]
-    if (Ed.cy >= Ed.scrollYOffset + Ed.screenRows) {
-        Ed.scrollYOffset = Ed.cy - Ed.screenRows + 1;
+    for(int i=st->merged;i<st->numChunks;i++) free(st->chunks[i].m);
+
+    free(st->threads);
+    free(st->chunks);
+    free(st->query);
+    regexFree(st->re);
+    if(st->match){
+        regexMatcherFree(st->match);
+        free(st->match);
     }
+    st->threads = NULL;
+    st->chunks = NULL;
+    st->query = NULL;
+    st->re = NULL;
+    st->match = NULL;
+    st->numChunks = st->merged = 0;
+    st->resumeFrom = -1;
+    st->numMatches = 0;
+    st->jumped = 0;
+}
 
+// every row has been scanned, the index is the full answer
+int editorSearchComplete(){
+    return !Ed.search.active && Ed.search.resumeFrom < 0;
+}
 
-    if (Ed.rx < Ed.scrollXOffset + GetLineNoBarWidth()) {
-        Ed.scrollXOffset = Ed.rx-GetLineNoBarWidth();
-    }
+// index of the first match at or after (y,x)
+int editorSearchLowerBound(int y, int x){
+    struct searchState *st = &Ed.search;
+    int lo = 0, hi = st->numMatches;
 
-    // same thing for scroll down, [to view content below when scrolling down]
-    if (Ed.rx >= Ed.scrollXOffset + Ed.screenCols + GetLineNoBarWidth()) {
-        Ed.scrollXOffset = Ed.rx - Ed.screenCols + 1 - GetLineNoBarWidth();
+    while(lo < hi){
+        int mid = lo + (hi - lo) / 2;
+        struct searchMatch *m = &st->matches[mid];
+        if(m->y < y || (m->y == y && m->x < x)) lo = mid + 1;
+        else hi = mid;
     }
+    return lo;
 }
 
-/*
-    WHY?? 
-    If you try to scroll back up, you may notice the cursor isn’t being positioned properly.
-    That is because E.cy no longer refers to the position of the cursor on the screen. 
-    It refers to the position of the cursor within the text file. 
-    To position the cursor on the screen, we now have to subtract E.rowoff from the value of E.cy.
-*/
-
-void editorRefreshScreen(){
-    editorScroll();
+void editorSearchJump(int i){
+    struct searchState *st = &Ed.search;
 
-    /* 
-        Escape sequences are used to put nonprintable characters in character and string literals
-        such as backspace, tab, color, cursor locations etc.
-    */
+    st->jumped = 1;
+    Ed.cy = st->matches[i].y;
+    Ed.cx = st->matches[i].x;
+    Ed.scrollYOffset = Ed.numRows; // to make screen scroll to matched line
+}
 
-    struct ab_buf b = ab_BUF_INIT;
-    
-    ab_append(&b, "\x1b[?25l", 6); // disable pointer
+/*
+    until the first jump, looks for the first match at or after the origin,
+    wrapping to the top once every chunk is in. returns 1 if it jumped.
+*/
+int editorSearchJumpFromOrigin(){
+    struct searchState *st = &Ed.search;
+    if(st->jumped) return 0;
+
+    int i = editorSearchLowerBound(st->originY, st->originX);
+    if(i < st->numMatches){
+        editorSearchJump(i);
+        return 1;
+    }
+    if(editorSearchComplete() && st->numMatches){
+        editorSearchJump(0);
+        return 1;
+    }
+    return 0;
+}
 
-    // set ptr color
-    ab_append(&b, "\x1b]12;#b3b3b3\x1b\\", 16);
+// moves finished chunks to matches, in row order. returns 1 if any moved
+int editorSearchMergeChunks(){
+    struct searchState *st = &Ed.search;
+    int changed = 0;
 
-    // set cursor style 
-    // ab_append(&b, "\x1b[5 q", 5);
+    while(st->merged < st->numChunks && atomic_load(&st->chunks[st->merged].done)){
+        struct searchChunk *ch = &st->chunks[st->merged];
 
-    // this will adjust the cursor position to top-left
-    // read here about '[H': https://vt100.net/docs/vt100-ug/chapter3.html#CUP
-    ab_append(&b, "\x1b[H", 3);
+        if(st->numMatches + ch->count > st->capMatches){
+            st->capMatches = st->capMatches ? st->capMatches * 2 : 64;
+            while(st->capMatches < st->numMatches + ch->count) st->capMatches *= 2;
+            st->matches = realloc(st->matches, sizeof(struct searchMatch) * st->capMatches);
+            if(st->matches == NULL) die("realloc");
+        }
+        memcpy(&st->matches[st->numMatches], ch->m, sizeof(struct searchMatch) * ch->count);
+        st->numMatches += ch->count;
+        free(ch->m);
+        st->merged++;
+        changed = 1;
+    }
+    return changed;
+}
 
+// merges what the workers have, returns 1 if anything changed
+int editorSearchMerge(){
+    struct searchState *st = &Ed.search;
+    int changed = editorSearchMergeChunks();
 
-    // draw
-    editorDrawRows(&b);
-    editorDrawStatusBar(&b);
-    editorDrawStatusMessage(&b);
+    if(st->active && st->merged == st->numChunks){
+        for(int i=0;i<st->numThreads;i++) pthread_join(st->threads[i], NULL);
+        st->active = 0;
+        changed = 1; // count is final now
+    }
 
-    // to position the cursor according to our cursor pos variables.
-    char buf[32];
+    return editorSearchJumpFromOrigin() || changed;
+}
 
-    debugLog("%d, %d", Ed.cx, Ed.rx);
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", Ed.cy - Ed.scrollYOffset + 1, Ed.rx - Ed.scrollXOffset + 1);
-    ab_append(&b, buf, strlen(buf));
+/*
+    stops the workers before an edit moves rows under them, without
+    waiting for the rest of the file. chunks they finished stay in the
+    index, the rows after them are scanned again from resumeFrom once
+    the editor is idle (editorSearchResume).
+*/
+void editorSearchPause(){
+    struct searchState *st = &Ed.search;
+    if(!st->active) return;
+
+    atomic_store(&st->cancel, 1);
+    for(int i=0;i<st->numThreads;i++) pthread_join(st->threads[i], NULL);
+    atomic_store(&st->cancel, 0); // edits rescan their rows with the same scanner
+    st->active = 0;
+    editorSearchMergeChunks();
+
+    st->resumeFrom = st->merged < st->numChunks ? st->chunks[st->merged].start : -1;
+    for(int i=st->merged;i<st->numChunks;i++) free(st->chunks[i].m);
+    free(st->chunks);
+    free(st->threads);
+    st->chunks = NULL;
+    st->threads = NULL;
+    st->numChunks = st->merged = 0;
+}
 
-    ab_append(&b, "\x1b[?25h", 6); // enable pointer
-    
-    write(STDOUT_FILENO, b.buf, b.len); //finally writing buffer to stdout
-    
-    ab_free(&b);
+// goes on with a paused scan
+void editorSearchResume(){
+    struct searchState *st = &Ed.search;
+    if(st->active || st->resumeFrom < 0) return;
+    editorSearchLaunch(st->resumeFrom);
 }
 
+// blocks until every row is scanned
+void editorSearchFinish(){
+    editorSearchResume();
+    while(Ed.search.active){
+        if(!editorSearchMerge()){
+            struct timespec ts = {0, 1000000}; // 1ms
+            nanosleep(&ts, NULL);
+        }
+    }
+}
 
-/* ----- file-io ----- */
+// starts looking for query from the cursor, small files are scanned right away
+void editorSearchStart(const char *query){
+    struct searchState *st = &Ed.search;
 
-void editorOpenFile(char *filename){
-    FILE *file_ptr;
+    editorSearchStop();
+    st->qlen = strlen(query);
+    if(st->qlen == 0) return;
 
-    Ed.filename = strdup(filename);
+    st->query = strdup(query);
+    if(st->regex && (st->re = regexCompile(query)) != NULL){
+        st->match = malloc(sizeof(struct reMatcher));
+        if(st->match == NULL) die("malloc");
+        regexMatcherInit(st->match, st->re);
+    }
+    st->originY = Ed.cy;
+    st->originX = Ed.cx;
+    editorSearchLaunch(0);
+}
 
-    file_ptr = fopen(filename, "r");
+// hands rows [from, numRows) to the workers, matches are appended
+void editorSearchLaunch(int from){
+    struct searchState *st = &Ed.search;
 
-    if(file_ptr==NULL)die("fopen");
+    st->merged = 0;
+    st->resumeFrom = -1;
+    atomic_store(&st->nextChunk, 0);
+    atomic_store(&st->cancel, 0);
 
-    char *lineData = NULL;
-    ssize_t linelen = 0;
-    size_t linecap = 0; //stores current length of data stored in lineData.
+    st->numChunks = (Ed.numRows - from + SEARCH_CHUNK_ROWS - 1) / SEARCH_CHUNK_ROWS;
+    if(st->numChunks <= 0){
+        st->numChunks = 0;
+        editorSearchJumpFromOrigin();
+        return;
+    }
+    st->chunks = calloc(st->numChunks, sizeof(struct searchChunk));
+    if(st->chunks == NULL) die("calloc");
+    for(int i=0;i<st->numChunks;i++){
+        st->chunks[i].start = from + i * SEARCH_CHUNK_ROWS;
+        st->chunks[i].end = st->chunks[i].start + SEARCH_CHUNK_ROWS;
+        if(st->chunks[i].end > Ed.numRows) st->chunks[i].end = Ed.numRows;
+    }
 
-    // linelen = ;
-    
+    if(st->numChunks == 1){ // not worth a thread
+        editorSearchScanChunk(st, &st->chunks[0], st->match);
+        atomic_store(&st->chunks[0].done, 1);
+        editorSearchMerge();
+        return;
+    }
 
-    while((linelen = getline(&lineData, &linecap, file_ptr)) != -1){
-        // strip off the newline or carriage return at the end
-        while(linelen > 0 && (lineData[linelen-1]=='\n' || lineData[linelen-1]=='\r')){
-            linelen--;
-        }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    st->numThreads = cores < 1 ? 1 : cores > 64 ? 64 : cores;
+    if(st->numThreads > st->numChunks) st->numThreads = st->numChunks;
 
-        // saving line to buffer
-        editorInsertRow(lineData,linelen,Ed.numRows);
+    st->threads = malloc(sizeof(pthread_t) * st->numThreads);
+    for(int i=0;i<st->numThreads;i++){
+        if(pthread_create(&st->threads[i], NULL, editorSearchWorker, st) != 0) die("pthread_create");
     }
-
-    free(lineData);
-    fclose(file_ptr);
-    Ed.dirty=0; // because this fn calls editorAppend which 
-                // make file status as modified but its not when we
-                // newly open file.
+    st->active = 1;
+    editorSearchMerge();
 }
 
-char* editorFileDataToString(int *buflen){
-    int totLen = 0;
-    for(int i=0;i<Ed.numRows;i++){
-        totLen += Ed.row[i].size+1; // 1 for newline char
+/*
+    the query got longer: its matches are a subset of the old ones (which
+    overlap, so none is missed), only those still matching are kept.
+*/
+void editorSearchNarrow(const char *query){
+    struct searchState *st = &Ed.search;
+    int qlen = strlen(query), n = 0;
+
+    for(int i=0;i<st->numMatches;i++){
+        struct searchMatch m = st->matches[i];
+        erow *row = editorRowAt(m.y);
+        if(m.x + qlen <= row->size && memcmp(&row->data[m.x], query, qlen) == 0){
+            m.len = qlen;
+            st->matches[n++] = m;
+        }
     }
-    
-    *buflen = totLen;
-    char *buf = malloc(totLen);
-    char *ptr = buf;
-    for(int i=0;i<Ed.numRows;i++){ 
-        memcpy(ptr,Ed.row[i].data, Ed.row[i].size);
-        ptr += Ed.row[i].size;
+    st->numMatches = n;
 
-        *ptr = '\n';
-        ptr++;
-    }
-    return buf;
+    free(st->query);
+    st->query = strdup(query);
+    st->qlen = qlen;
+    st->jumped = 0;
+    editorSearchJumpFromOrigin();
 }
 
-
-/*  For Bash on Windows, you will have to press Escape 3 times 
-    to get one Escape keypress to register in our program  
+/*
+    keeps the match index in sync with an edit that turned rows
+    [y, y+oldSpan] into [y, y+newSpan]: only those rows are scanned again,
+    matches below just move by the row difference.
 */
-void editorSaveFile(){
-    if(Ed.filename==NULL){
-        Ed.filename = editorPrompt("Save as: %s (ESC to cancel | Enter to save)",NULL);
-        
-        if (Ed.filename == NULL) {
-            editorRefreshScreen();
-            editorSetStatusMessage("Save aborted");
+void editorSearchEdit(int y, int oldSpan, int newSpan){
+    struct searchState *st = &Ed.search;
+    if(st->query == NULL) return;
+
+    if(st->resumeFrom >= 0){ // paused, rows from resumeFrom are not in the index
+        if(y + oldSpan >= st->resumeFrom){
+            // the edit reaches the unscanned rows, rescan from it on resume
+            if(y < st->resumeFrom){
+                st->numMatches = editorSearchLowerBound(y, 0);
+                st->resumeFrom = y;
+            }
             return;
         }
+        st->resumeFrom += newSpan - oldSpan;
     }
-    
-    int len;
-    char* buf = editorFileDataToString(&len);
 
-    /*  O_CREAT: create new file if doesn;t exist.
-        0644: this give write permission to only owner.
-        O_RDWR: to read and write both 
-    */
-    int fd = open(Ed.filename, O_CREAT | O_RDWR, 0644);
+    struct searchChunk ch = {0};
+    ch.start = y;
+    ch.end = y + newSpan + 1;
+    editorSearchScanChunk(st, &ch, st->match);
 
-    if(fd!=-1){
-        if(ftruncate(fd, len)!=-1){
-            if(write(fd, buf, len)==len){
-                close(fd);
-                free(buf);
-                editorSetStatusMessage("%d bytes written to disk", len);
-                Ed.dirty = 0;
+    int lo = editorSearchLowerBound(y, 0);
+    int hi = editorSearchLowerBound(y + oldSpan + 1, 0);
+    int num = st->numMatches - (hi - lo) + ch.count;
 
-                return;
-            }
-        }
-        close(fd);
+    if(num > st->capMatches){
+        st->capMatches = st->capMatches ? st->capMatches * 2 : 64;
+        while(st->capMatches < num) st->capMatches *= 2;
+        st->matches = realloc(st->matches, sizeof(struct searchMatch) * st->capMatches);
+        if(st->matches == NULL) die("realloc");
     }
-    free(buf);
-    editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
-}   
 
-/* ----- search ----- */
+    memmove(&st->matches[lo + ch.count], &st->matches[hi], sizeof(struct searchMatch) * (st->numMatches - hi));
+    for(int i=lo+ch.count;i<num;i++) st->matches[i].y += newSpan - oldSpan;
+    if(ch.count) memcpy(&st->matches[lo], ch.m, sizeof(struct searchMatch) * ch.count);
+    st->numMatches = num;
+    free(ch.m);
+}
 
 void editorFallBackSearch(char* query, int keyPress){
-    static int last_match_y = -1;
-    static int direction = 1; 
-    
-    if(keyPress=='\r'||keyPress=='\x1b'){
-        last_match_y = -1;
-        direction = 1;
+    struct searchState *st = &Ed.search;
+
+    if(keyPress=='\x1b'){
+        editorSearchStop();
         return;
+    }else if(keyPress=='\r'){
+        return; // the index stays, matches remain highlighted
     }else if(keyPress == ARROW_DOWN || keyPress == ARROW_RIGHT){
-        direction = 1;
+        // next match, wraps only once all of them are known
+        int i = editorSearchLowerBound(Ed.cy, Ed.cx + 1);
+        if(i < st->numMatches) editorSearchJump(i);
+        else if(editorSearchComplete() && st->numMatches) editorSearchJump(0);
     }else if(keyPress == ARROW_UP || keyPress == ARROW_LEFT){
-        direction = -1;
-    }else{
-        last_match_y = -1;
-        direction = 1;
-    }
-
-    int current_y = last_match_y;
+        int i = editorSearchLowerBound(Ed.cy, Ed.cx) - 1;
+        if(i >= 0) editorSearchJump(i);
+        else if(editorSearchComplete() && st->numMatches) editorSearchJump(st->numMatches - 1);
+    }else if(st->query == NULL || strcmp(query, st->query) != 0){
+        // query changed, search again from where the search began
+        if(st->query){
+            Ed.cy = st->originY;
+            Ed.cx = st->originX;
+        }
 
-    for(int i=0;i<Ed.numRows;i++){
-        current_y+=direction;
-        if(current_y == -1) current_y = Ed.numRows - 1;
-        else if(current_y == Ed.numRows) current_y = 0;
+        int qlen = strlen(query);
+        if(!st->regex && st->query && editorSearchComplete() && qlen > st->qlen && strncmp(query, st->query, st->qlen) == 0){
+            editorSearchNarrow(query);
+        }else{
+            editorSearchStart(query);
+        }
+    }
+}
 
-        erow* row = &Ed.row[current_y];
-        char* ptr = strstr(row->renderData, query);
-        // ptr to matched substr in row->renderData
+/*
+    replaces every occurrence of find. all matches are known before
+    anything changes (the search index, found by the search threads),
+    then each affected row is rebuilt in one allocation of its final size.
+    the whole replace is one undo group: per row the old text is deleted
+    and the new text inserted.
+*/
+int editorReplaceAll(const char *find, const char *with){
+    struct searchState *st = &Ed.search;
+    int findLen = strlen(find), withLen = strlen(with), count = 0;
+    int cx = Ed.cx, cy = Ed.cy, scrollY = Ed.scrollYOffset;
+
+    editorIndexFinish();
+    editorSearchStop();
+    st->regex = 0;
+    editorSearchStart(find);
+    editorSearchFinish();
+    Ed.cx = cx; // starting a search jumps to the first match
+    Ed.cy = cy;
+    Ed.scrollYOffset = scrollY;
+
+    Ed.undo.keySeq = -1; // a group of its own, even right after typing
+    for(int i=0;i<st->numMatches;){
+        int y = st->matches[i].y, j = i, n = 0, end = 0;
+
+        // the matches are overlapping, take them left to right
+        for(; j < st->numMatches && st->matches[j].y == y; j++){
+            if(st->matches[j].x < end) continue;
+            end = st->matches[j].x + findLen;
+            n++;
+        }
 
-        if(ptr){
-            // debugLog("%s%d",row->data, row->size);
+        erow *row = editorRowAt(y);
+        int len = row->size + n * (withLen - findLen);
+        char *data = malloc(len + 1), *out = data;
+        if(data == NULL) die("malloc");
+
+        int from = 0;
+        for(; i < j; i++){
+            int x = st->matches[i].x;
+            if(x < from) continue;
+            memcpy(out, &row->data[from], x - from);
+            out += x - from;
+            memcpy(out, with, withLen);
+            out += withLen;
+            from = x + findLen;
+        }
+        memcpy(out, &row->data[from], row->size - from);
+        data[len] = '\0';
+
+        editorUndoRecordDelete(y, 0, y, row->size);
+        editorSwapRecordDelete(y, 0, y, row->size);
+        editorRowReplaceData(row, data, len);
+        editorUndoRecordInsert(y, 0, data, len, y, len);
+        editorSwapRecordInsert(y, 0, data, len);
+        count += n;
+    }
+    editorSearchStop();
 
-            last_match_y = current_y;
+    if(Ed.cy < Ed.numRows && Ed.cx > editorRowAt(Ed.cy)->size) Ed.cx = editorRowAt(Ed.cy)->size;
+    return count;
+}
 
-            // Ed.rx = ;
+void editorReplace(){
+    char *find = editorPrompt("Replace: %s (Esc : cancel)", NULL);
+    if(find == NULL) return;
 
-            Ed.cy = current_y;
-            Ed.cx = editorRxToCx(row,ptr - row->renderData);
-            
-            Ed.scrollYOffset=Ed.numRows; // to make screen scroll to matched line
-            break;
-        }
+    char *with = editorPromptEmpty("Replace with: %s (Esc : cancel | Enter on empty : delete)");
+    if(with){
+        int count = editorReplaceAll(find, with);
+        editorSetStatusMessage("Replaced %d occurrence%s%s", count, count == 1 ? "" : "s",
+                               Ed.undo.lostSeq == Ed.keySeq ? ", too large to undo" : "");
+        free(with);
     }
+    free(find);
 }
 
-void editorSearch(){
+// regex: query is a regular expression instead of a literal
+void editorSearch(int regex){
+    editorIndexFinish();
+    editorSearchStop();
+    Ed.search.regex = regex;
     // saving cursor position to restore it after escaping search
     int old_cx = Ed.cx;
     int old_cy = Ed.cy;
@@ -987,7 +4434,8 @@ void editorSearch(){
 
     // this fallback func will be called again and again after keypress
     // [look at editorPrompt func to understand why!]
-    char* query = editorPrompt("Search: %s (Esc : cancel | arrows : nextSearch | Enter : end search)", editorFallBackSearch);
+    char* query = editorPrompt(regex ? "Regex: %s (Esc : cancel | arrows : nextSearch | Enter : end search)"
+                                     : "Search: %s (Esc : cancel | arrows : nextSearch | Enter : end search)", editorFallBackSearch);
     if (query) {
         free(query);
     }else{  
@@ -1001,13 +4449,36 @@ void editorSearch(){
 
 /* ----- input processing ----- */
 
+// runs whenever editorReadKey is waiting for input
+void editorIdle(){
+    if(Ed.index.active){
+        editorIndexMerge();
+        editorRefreshScreen(); // shows the growing line count
+    }
+    if(Ed.search.resumeFrom >= 0){
+        editorSearchResume(); // a scan paused by an edit goes on
+    }
+    if(Ed.search.active && editorSearchMerge()){
+        editorRefreshScreen();
+    }
+    if(Ed.save.active){
+        if(atomic_load(&Ed.save.done)) editorSaveFinish();
+        editorRefreshScreen(); // progress, then the result
+    }
+    if(Ed.swap.wantCompact){
+        editorIndexFinish();
+        editorSwapCompact();
+    }
+    traceIdle();
+}
+
 void editorMoveCursor(int key) {
 
     // storing current row to avoid moving towards
     // right of the content in line without pressing space.
     erow *curRow = NULL;
     if(Ed.cy < Ed.numRows){ //cursor on some file's line
-        curRow = &Ed.row[Ed.cy];
+        curRow = editorRowAt(Ed.cy);
     }
 
     switch (key) {
@@ -1024,7 +4495,7 @@ void editorMoveCursor(int key) {
                 Ed.cx--;
             }else if(Ed.cy > 0){
                 Ed.cy--;
-                Ed.cx = Ed.row[Ed.cy].size;
+                Ed.cx = editorRowAt(Ed.cy)->size;
             }
             break;
 
@@ -1054,7 +4525,7 @@ void editorMoveCursor(int key) {
     // and if that new row is shorter in length, its an issue!
 
     if(Ed.cy < Ed.numRows){ //cursor on some file's line
-        curRow = &Ed.row[Ed.cy];
+        curRow = editorRowAt(Ed.cy);
     }else curRow = NULL;
 
     if(curRow && Ed.cx > curRow->size)Ed.cx = curRow->size;
@@ -1062,115 +4533,95 @@ void editorMoveCursor(int key) {
 
 }
 
-void editorDeleteSelectedData(){
-    // Calculate the actual length without '\r', '\n', and '\0'
-    int actualLen = 0;
-    for (int i = 0; i < Ed.selectedDataLen; i++) {
-        char ch = Ed.selectedData[i];
-        if (ch != '\n' && ch != '\0') {
-            actualLen++;
-        }
+/*
+    selected text as a range in file order: (sy,sx) up to, not including,
+    (ey,ex). returns 0 if the selection is empty.
+*/
+int editorSelectionRange(int *sy, int *sx, int *ey, int *ex){
+    if(Ed.numRows == 0) return 0;
+
+    int stX = Ed.sx, stY = Ed.sy, enX = Ed.ex, enY = Ed.ey;
+
+    // whichever end comes first in the file is the start
+    if(stY > enY || (stY == enY && stX > enX)){
+        stX = Ed.ex; stY = Ed.ey;
+        enX = Ed.sx; enY = Ed.sy;
     }
 
-    // set starting pointer to 
-    // whichever is later in text file
-    // because backspace move in this '<--' direction.
-    if(Ed.sy==Ed.ey){
-        if(Ed.sx > Ed.ex){
-            Ed.cx = Ed.sx;
-        }
-    }else if(Ed.sy > Ed.ey){
-        Ed.cx = Ed.sx;
-        Ed.cy = Ed.sy;
+    // selection includes the char under its end, past the end of
+    // a row that is the line break.
+    if(enY >= Ed.numRows){
+        enY = Ed.numRows - 1;
+        enX = editorRowAt(enY)->size;
+    }else if(enX + 1 > editorRowAt(enY)->size && enY + 1 < Ed.numRows){
+        enY++;
+        enX = 0;
+    }else if(enX + 1 <= editorRowAt(enY)->size){
+        enX++;
     }
+    if(stY >= Ed.numRows) return 0;
+
+    *sy = stY; *sx = stX;
+    *ey = enY; *ex = enX;
+    return 1;
+}
+
+void editorDeleteSelectedData(){
+    int sy, sx, ey, ex;
+    if(!editorSelectionRange(&sy, &sx, &ey, &ex)) return;
+
+    editorDeleteRange(sy, sx, ey, ex);
+    Ed.cy = sy;
+    Ed.cx = sx;
+}
+
+// materializes the selected text into copiedData, in one allocation
+void editorCopySelection(){
+    int sy, sx, ey, ex;
+    struct textIter it;
+    const char *span;
+    int spanLen, len = 0;
+
+    free(Ed.copiedData);
+    Ed.copiedData = NULL;
+    Ed.copiedDataLen = 0;
+    Ed.copied = 0;
+    if(!editorSelectionRange(&sy, &sx, &ey, &ex)) return;
 
-    // using actualLen to remove chars
-    editorMoveCursor(ARROW_RIGHT);
-    while (actualLen--) {
-        editorDeleteChar(); 
+    editorTextIterInit(&it, sy, sx, ey, ex);
+    while(editorTextIterNext(&it, &span, &spanLen)) len += spanLen;
+
+    Ed.copiedData = malloc(len + 1);
+    editorTextIterInit(&it, sy, sx, ey, ex);
+    while(editorTextIterNext(&it, &span, &spanLen)){
+        memcpy(&Ed.copiedData[Ed.copiedDataLen], span, spanLen);
+        Ed.copiedDataLen += spanLen;
     }
+    Ed.copiedData[len] = '\0';
+    Ed.copied = 1;
 }
 
 void editorUpdateSelectedData() {
     /*
         Main idea:
         I keep Ed.sx,Ed.sy always as the point from where
-        we started selecting text (with SHIFT+X).
-
-        then from Ed.ex,Ed.ey, even if any one is less that start 
-        cords, I take care of it while memmove data from 
-        row data to -> selectedData buffer.
-        how? by taking min of both wherever necessary!!
+        we started selecting text (with SHIFT+X), the other end
+        just follows the cursor. nothing is copied here, the
+        text is read out of the rows when its needed.
     */
 
     if (Ed.selected) {
         Ed.ex = Ed.cx;
         Ed.ey = Ed.cy; 
-
-        int len = 0;
-        if (Ed.sy == Ed.ey) { // copying within single line
-
-            len = (Ed.ex>Ed.sx ? Ed.ex - Ed.sx: Ed.sx - Ed.ex) + 1;
-            Ed.selectedDataLen = len;
-
-            Ed.selectedData = malloc(len+1);
-            memmove(Ed.selectedData, &Ed.row[Ed.sy].data[(Ed.ex<Ed.sx?Ed.ex:Ed.sx)], len);
-            Ed.selectedData[len++] = '\0';
-
-        } else { // copying multiple lines
-            int len;
-
-            if(Ed.ey != Ed.sy){
-                len = Ed.row[(Ed.ey<Ed.sy?Ed.ey:Ed.sy)].size - (Ed.ey<Ed.sy?Ed.ex:Ed.sx);
-                Ed.selectedData = malloc(len+2);
-                
-                memmove(Ed.selectedData, &Ed.row[(Ed.ey<Ed.sy?Ed.ey:Ed.sy)].data[(Ed.ey<Ed.sy?Ed.ex:Ed.sx)], len);
-                Ed.selectedData[len++] = '\r';
-                Ed.selectedData[len++] = '\n';
-
-            }else{
-                len = (Ed.ex>Ed.sx ? Ed.ex - Ed.sx: Ed.sx - Ed.ex) + 1;
-                Ed.selectedData = malloc(len+1);
-
-                memmove(Ed.selectedData, &Ed.row[Ed.sy].data[(Ed.ex<Ed.sx?Ed.ex:Ed.sx)], len);                
-                Ed.selectedData[len++] = '\0';
-                    
-            }
-
-            // In between
-            for (int i = (Ed.ey<Ed.sy?Ed.ey:Ed.sy) + 1; i < (Ed.ey<Ed.sy?Ed.sy:Ed.ey); i++) {
-                int prevLen = len;
-
-                int ad = Ed.row[i].size;
-                len += ad;
-                
-                Ed.selectedData = realloc(Ed.selectedData, len+2);
-                memmove(Ed.selectedData + prevLen, Ed.row[i].data, ad);
-                
-                Ed.selectedData[len++] = '\r';
-                Ed.selectedData[len++] = '\n';
-
-                
-            }
-
-            // Last line
-            if(Ed.ey != Ed.sy){
-                len += ((Ed.ey<Ed.sy?Ed.sx:Ed.ex) + 1);
-                Ed.selectedData = realloc(Ed.selectedData, len+1);
-                memmove(Ed.selectedData + len - ((Ed.ey<Ed.sy?Ed.sx:Ed.ex) + 1), Ed.row[(Ed.ey<Ed.sy?Ed.sy:Ed.ey)].data, (Ed.ey<Ed.sy?Ed.sx:Ed.ex) + 1);
-            
-                Ed.selectedData[len++] = '\0';
-                Ed.selectedDataLen = len;
-
-            }
-        }
     }
 }
 
 
 void editorProcessKey(){
     int c = editorReadKey();
+    TRACE("key", c, Ed.keySeq + 1);
     Ed.START=1;
+    Ed.keySeq++;
     static int quit_cntr = TEXTER_QUIT_CONFIRM;
     
     // handle selected data ends
@@ -1186,7 +4637,15 @@ void editorProcessKey(){
     // Processing keyboard button
     switch (c){
         case CTRL_KEY('f'):
-            editorSearch();
+            editorSearch(0);
+            break;
+
+        case CTRL_KEY('r'):
+            editorSearch(1);
+            break;
+
+        case CTRL_KEY('t'):
+            editorReplace();
             break;
              
         case CTRL_KEY('s'):
@@ -1209,16 +4668,23 @@ void editorProcessKey(){
             break;
 
         case CTRL_KEY('z'):
-            // restore
-            
+            editorUndo();
+            break;
+
+        case CTRL_KEY('y'):
+            editorRedo();
+            break;
 
-            break;        
         case CTRL_KEY('l'): // to refresh screen
+            editorInvalidateFrame();
+            break;
+
         case '\x1b': //escape
-            // ignoring!
+            editorSearchStop(); // drops the search highlight
             break;
 
         case CTRL_KEY('q'):
+            editorSaveWait();
             if(Ed.dirty && quit_cntr){
                 editorSetStatusMessage("WARNING!!! File has unsaved changes."
                 "Press Ctrl-Q %d more times to quit.", quit_cntr);   
@@ -1226,6 +4692,8 @@ void editorProcessKey(){
                 return;
             }
 
+            editorSwapClose(1); // quitting keeps nothing to recover
+
             // to adjust cursor position and screen clear when program stops
             write(STDOUT_FILENO, "\x1b[2J", 4);
             write(STDOUT_FILENO, "\x1b[H", 3);    
@@ -1254,7 +4722,7 @@ void editorProcessKey(){
             break;
         case END_KEY:
             if (Ed.cy < Ed.numRows)
-                Ed.cx = Ed.row[Ed.cy].size;
+                Ed.cx = editorRowAt(Ed.cy)->size;
             break;
         
         // Paste text
@@ -1262,15 +4730,21 @@ void editorProcessKey(){
             editorPasteData();
             break;
 
+        case PASTE_START:
+            editorPasteInput();
+            break;
+
+#ifdef TEXTER_PROFILE
+        case CTRL_KEY('p'):
+            profToggleOverlay();
+            break;
+#endif
+
         // Copy text
         case CTRL_KEY('c'):
             if(Ed.selected){ // selected text copied with ctrl+c
-                Ed.copied = 1;
-
-                erow tmp;
-                tmp.data=Ed.selectedData;
-                tmp.size=Ed.selectedDataLen;
-                editorSetStatusMessage("Copied data: (%d,%d) to (%d,%d)",Ed.sy+1,editorCxToRx(&tmp, Ed.sx)-GetLineNoBarWidth()+1,Ed.ey+1,editorCxToRx(&tmp, Ed.ex)-GetLineNoBarWidth()+1);
+                editorCopySelection();
+                editorSetStatusMessage("Copied data: (%d,%d) to (%d,%d)",Ed.sy+1,Ed.sx+1,Ed.ey+1,Ed.ex+1);
             }else{
                 // selected Data is NULL
                 editorSetStatusMessage("Copied data: (blank)");
@@ -1294,24 +4768,12 @@ void editorProcessKey(){
     // handle select data
     if(Ed.selected && c!=SHIFT_ARROW_DOWN &&  c!=SHIFT_ARROW_UP &&  c!=SHIFT_ARROW_LEFT &&  c!=SHIFT_ARROW_RIGHT){
         // we left shift+x selection process
-        
-        if(Ed.copied){ // if copied, store it
-        
-            Ed.copiedData = malloc(Ed.selectedDataLen+1);
-            memmove(Ed.copiedData, Ed.selectedData, Ed.selectedDataLen);
-            Ed.copiedDataLen = Ed.selectedDataLen;
-            Ed.copiedData[Ed.copiedDataLen++]='\0';
-        }
-
         Ed.selected = 0;
-        Ed.selectedData = NULL;
-        Ed.selectedDataLen = 0;
-
-        // debugLog("%d|\r\n%s\r\n%d|\r\n%d|\r\n%s\r\n%d|\r\n", Ed.selected, Ed.selectedData, Ed.selectedDataLen, Ed.copied, Ed.copiedData, Ed.copiedDataLen);
     }
 }
 
-char *editorPrompt(char *prompt, void (*callback)(char*, int)) {
+// allowEmpty: Enter on an empty line submits "" instead of being ignored
+char *editorPromptWith(char *prompt, void (*callback)(char*, int), int allowEmpty) {
     size_t bufsize = 128;
     char *buf = malloc(bufsize);
     size_t buflen = 0;
@@ -1334,13 +4796,27 @@ char *editorPrompt(char *prompt, void (*callback)(char*, int)) {
             free(buf);
 
             return NULL; // will cause cursor position to reset! 
+        } else if (c == PASTE_START) {
+            // one line prompt, line breaks and other control bytes are dropped
+            struct ab_buf text = ab_BUF_INIT;
+            editorReadPaste(&text);
+            for (int i = 0; i < text.len; i++) {
+                if ((unsigned char)text.buf[i] >= 128 || iscntrl(text.buf[i])) continue;
+                if (buflen == bufsize - 1) {
+                    bufsize *= 2;
+                    buf = realloc(buf, bufsize);
+                }
+                buf[buflen++] = text.buf[i];
+                buf[buflen] = '\0';
+            }
+            ab_free(&text);
         } else if (c == '\r') {
-            if (buflen != 0) {
+            if (buflen != 0 || allowEmpty) {
                 editorSetStatusMessage("");
                 if(callback) callback(buf, c);
                 return buf;
             }
-        }else if (!iscntrl(c) && c < 128) {
+        }else if (c < 128 && !iscntrl(c)) {
             if (buflen == bufsize - 1) {
                 bufsize *= 2;
                 buf = realloc(buf, bufsize);
@@ -1352,10 +4828,22 @@ char *editorPrompt(char *prompt, void (*callback)(char*, int)) {
     }
 }
 
+char *editorPrompt(char *prompt, void (*callback)(char*, int)) {
+    return editorPromptWith(prompt, callback, 0);
+}
+
+char *editorPromptEmpty(char *prompt) {
+    return editorPromptWith(prompt, NULL, 1);
+}
+
 
 /* ----- main ----- */
 
-void initEditor() {
+/*
+    sets up the editor core for a screen of rows x cols, without touching
+    the terminal. headless drivers call this instead of initEditor.
+*/
+void editorInit(int rows, int cols) {
     
     Ed.START=0;
 
@@ -1365,33 +4853,68 @@ void initEditor() {
     Ed.ex = 0;
     Ed.ey = 0;
     Ed.selected = 0;
-    Ed.selectedData = NULL;
-    Ed.selectedDataLen = 0;
     Ed.copied = 0;
     Ed.copiedData = NULL;
     Ed.copiedDataLen = 0;
 
+    memset(&Ed.undo, 0, sizeof(Ed.undo));
+    Ed.undo.lostSeq = -1;
+    memset(&Ed.search, 0, sizeof(Ed.search));
+    Ed.search.resumeFrom = -1;
+    memset(&Ed.save, 0, sizeof(Ed.save));
+    memset(&Ed.swap, 0, sizeof(Ed.swap));
+    Ed.keySeq = 0;
+
+    Ed.in.start = 0;
+    Ed.in.len = 0;
+    if(pipe(Ed.in.wake) == -1) die("pipe");
+    for(int i = 0; i < 2; i++){
+        fcntl(Ed.in.wake[i], F_SETFL, O_NONBLOCK);
+        fcntl(Ed.in.wake[i], F_SETFD, FD_CLOEXEC);
+    }
+
     Ed.rx = 0;
     Ed.cx = 0;
     Ed.cy = 0;
     
     Ed.numRows = 0;
-    Ed.row=NULL;  
+    Ed.row.rows = NULL;
+    Ed.row.cap = 0;
+    Ed.row.gapStart = 0;
+    Ed.row.gapEnd = 0;
     Ed.scrollXOffset = 0;
     Ed.scrollYOffset = 0;
     Ed.filename = NULL;
+    Ed.map = NULL;
+    Ed.mapLen = 0;
+    Ed.index.active = 0;
+    Ed.frame = NULL;
+    Ed.frameLines = 0;
+    Ed.frameScrollY = 0;
+    Ed.frameValid = 0;
+    Ed.out = (struct ab_buf)ab_BUF_INIT;
+    Ed.outFd = STDOUT_FILENO;
+    Ed.scratch = (struct ab_buf)ab_BUF_INIT;
     Ed.statusmsg[0] = '\0';
     Ed.statusmsg_time = 0;
     Ed.dirty = 0;
 
+    Ed.screenRows = rows - 2;
+    Ed.screenCols = cols - 4;
+}
+
+void initEditor() {
+    int rows, cols;
 
-    if (getWindowSize(&Ed.screenRows, &Ed.screenCols) == -1) {
+    if (getWindowSize(&rows, &cols) == -1) {
         die("getWindowSize");
     }
-    Ed.screenRows -= 2;
-    Ed.screenCols -= 4;
+    editorInit(rows, cols);
 }
 
+// bench.c includes this file for the editor core and brings its own main
+#ifndef TEXTER_NO_MAIN
+
 int main(int argc, char *argv[]){
     /*
         In raw mode, each character is processed immediately as it's typed, 
@@ -1399,6 +4922,8 @@ int main(int argc, char *argv[]){
         In contrast, canonical mode allows users to edit their input 
         (e.g., using backspace) until they press Enter to submit the line. 
     */
+    traceInit();
+    profInit();
     enableRawMode();
     initEditor();
     
@@ -1408,14 +4933,31 @@ int main(int argc, char *argv[]){
         editorInsertNewLine();
     }
     
-    editorSetStatusMessage("HELP: Ctrl-S : save | Ctrl-Q : quit | Ctrl-F : find | Ctrl-C : copy | Ctrl-V : paste");
+    // opening may have left a message about the swap file
+    if(Ed.statusmsg[0] == '\0') editorSetStatusMessage("HELP: Ctrl-S : save | Ctrl-Q : quit | Ctrl-F : find | Ctrl-C : copy | Ctrl-V : paste");
 
     while (1){
         editorRefreshScreen();
-        editorProcessKey();
+        long long frame = editorNowMs();
+        editorProcessKey(); // waits for the next key
+        profEditEnd();
+
+        // the rest of a burst is handled before the next frame is drawn
+        while (1){
+            if(editorKeyPending()){
+                editorProcessKey();
+                profEditEnd();
+                continue;
+            }
+            // keep collecting keys until the frame is due
+            long long wait = frame + FRAME_MIN_MS - editorNowMs();
+            if(wait > 0 && editorReadInput(wait) > 0) continue;
+            break;
+        }
     }
 
     return 0;
 
 }
 
+#endif